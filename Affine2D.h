@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_AFFINE2D_H
+#define LOVEWRAP_AFFINE2D_H
+
+// STL
+#include <cmath>
+
+// LOVE
+#include "common/Matrix.h"
+
+namespace lovewrap
+{
+
+// 2D affine transform, as 3x2 matrix:
+// | a c tx |
+// | b d ty |
+// Cheaper to build and compose than love::Matrix4 for 2D drawing.
+struct Affine2D
+{
+	float a, b, c, d, tx, ty;
+
+	Affine2D(): a(1.0f), b(0.0f), c(0.0f), d(1.0f), tx(0.0f), ty(0.0f) {}
+	Affine2D(float a, float b, float c, float d, float tx, float ty): a(a), b(b), c(c), d(d), tx(tx), ty(ty) {}
+	/**
+	 * Takes 2D part of Matrix4. Only exact if m.isAffine2DTransform().
+	 * @param m The matrix.
+	 */
+	explicit Affine2D(const love::Matrix4 &m)
+	{
+		const float *e = m.getElements();
+		a = e[0]; b = e[1];
+		c = e[4]; d = e[5];
+		tx = e[12]; ty = e[13];
+	}
+
+	// Applies other first, then this.
+	Affine2D operator*(const Affine2D &o) const
+	{
+		return Affine2D(
+			a * o.a + c * o.b,
+			b * o.a + d * o.b,
+			a * o.c + c * o.d,
+			b * o.c + d * o.d,
+			a * o.tx + c * o.ty + tx,
+			b * o.tx + d * o.ty + ty
+		);
+	}
+
+	love::Matrix4 toMatrix4() const
+	{
+		// Column-major
+		const float e[16] = {
+			a, b, 0.0f, 0.0f,
+			c, d, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			tx, ty, 0.0f, 1.0f
+		};
+
+		return love::Matrix4(e);
+	}
+};
+
+// Which parts of a draw transform are used, from least to most expensive.
+enum AffineKind
+{
+	AFFINE_TRANSLATE, // Position and origin only
+	AFFINE_SCALE,     // No rotation and no shear
+	AFFINE_GENERAL
+};
+
+// Builds the same transform as love::Matrix4(x, y, r, sx, sy, ox, oy, kx, ky),
+// skipping the parts which are known to be unused.
+template<AffineKind K>
+struct AffineBuilder
+{
+	static Affine2D build(float x, float y, float r, float sx, float sy, float ox, float oy, float kx, float ky)
+	{
+		float cr = cosf(r), sr = sinf(r);
+		float a = cr * sx - ky * sr * sy;
+		float b = sr * sx + ky * cr * sy;
+		float c = kx * cr * sx - sr * sy;
+		float d = kx * sr * sx + cr * sy;
+		return Affine2D(a, b, c, d, x - ox * a - oy * c, y - ox * b - oy * d);
+	}
+};
+
+template<>
+struct AffineBuilder<AFFINE_SCALE>
+{
+	static Affine2D build(float x, float y, float, float sx, float sy, float ox, float oy, float, float)
+	{
+		return Affine2D(sx, 0.0f, 0.0f, sy, x - ox * sx, y - oy * sy);
+	}
+};
+
+template<>
+struct AffineBuilder<AFFINE_TRANSLATE>
+{
+	static Affine2D build(float x, float y, float, float, float, float ox, float oy, float, float)
+	{
+		return Affine2D(1.0f, 0.0f, 0.0f, 1.0f, x - ox, y - oy);
+	}
+};
+
+/**
+ * Builds draw transform, picking the cheapest AffineBuilder for the arguments.
+ */
+inline Affine2D makeAffine(float x, float y, float r, float sx, float sy, float ox, float oy, float kx, float ky)
+{
+	if (r != 0.0f || kx != 0.0f || ky != 0.0f)
+		return AffineBuilder<AFFINE_GENERAL>::build(x, y, r, sx, sy, ox, oy, kx, ky);
+	else if (sx != 1.0f || sy != 1.0f)
+		return AffineBuilder<AFFINE_SCALE>::build(x, y, r, sx, sy, ox, oy, kx, ky);
+	else
+		return AffineBuilder<AFFINE_TRANSLATE>::build(x, y, r, sx, sy, ox, oy, kx, ky);
+}
+
+} // lovewrap
+
+#endif
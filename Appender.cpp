@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+#include <chrono>
+
+// lovewrap
+#include "Appender.h"
+
+namespace lovewrap
+{
+namespace filesystem
+{
+
+Appender::Appender(const std::string &filename, size_t bufferSize, OverflowMode mode)
+: mode(mode)
+, capacity(std::max(bufferSize, (size_t) 1))
+, threshold(capacity / 2)
+, interval(1.0)
+, appended(0)
+, flushed(0)
+, flushRequested(false)
+, closing(false)
+, closed(false)
+, stats({0, 0, 0, 0, 0, 0, 0})
+{
+	file.set(getInstance()->newFile(filename.c_str()), love::Acquire::NORETAIN);
+
+	if (!file->open(love::filesystem::File::MODE_APPEND))
+		throw love::Exception("Could not open file %s.", filename.c_str());
+
+	invalidateIndex(filename);
+	pending.reserve(capacity);
+	writing.reserve(capacity);
+	thread = std::thread(&Appender::threadMain, this);
+}
+
+Appender::~Appender()
+{
+	close();
+}
+
+void Appender::threadMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;)
+	{
+		auto timeout = std::chrono::duration<double>(interval);
+		threadCond.wait_for(lock, timeout, [this]() {return closing || flushRequested || pending.size() >= threshold;});
+		flushRequested = false;
+
+		if (!pending.empty())
+		{
+			std::swap(pending, writing);
+			flushed = appended;
+			spaceCond.notify_all();
+			lock.unlock();
+
+			bool success = false;
+			try
+			{
+				success = file->write(writing.data(), (int64_t) writing.size());
+			}
+			catch (love::Exception &) {}
+
+			// Size and modification time changed.
+			invalidateIndex(file->getFilename());
+
+			lock.lock();
+			stats.flushes++;
+
+			if (success)
+				stats.bytesWritten += writing.size();
+			else
+				stats.errors++;
+
+			writing.clear();
+			spaceCond.notify_all();
+		}
+		else if (closing)
+			break;
+	}
+}
+
+bool Appender::write(const void *data, size_t size)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (closing)
+		return false;
+
+	// Writes bigger than the buffer are allowed when it's empty.
+	if (!pending.empty() && pending.size() + size > capacity)
+	{
+		if (mode == OVERFLOW_DROP)
+		{
+			stats.dropped++;
+			stats.droppedBytes += size;
+			return false;
+		}
+
+		stats.blocked++;
+		flushRequested = true;
+		threadCond.notify_one();
+		spaceCond.wait(lock, [&]() {return closing || pending.empty() || pending.size() + size <= capacity;});
+
+		if (closing)
+			return false;
+	}
+
+	const char *bytes = (const char *) data;
+	pending.insert(pending.end(), bytes, bytes + size);
+	appended += size;
+	stats.writes++;
+
+	if (pending.size() >= threshold)
+		threadCond.notify_one();
+
+	return true;
+}
+
+void Appender::flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (closed)
+		return;
+
+	uint64_t target = appended;
+	flushRequested = true;
+	threadCond.notify_one();
+
+	// Taken from pending, and written.
+	spaceCond.wait(lock, [&]() {return flushed >= target && writing.empty();});
+}
+
+void Appender::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (closing)
+			return;
+
+		closing = true;
+		threadCond.notify_one();
+		spaceCond.notify_all();
+	}
+
+	thread.join();
+	file->close();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	closed = true;
+}
+
+bool Appender::isOpen()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return !closing;
+}
+
+void Appender::setFlushThreshold(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	threshold = std::max(bytes, (size_t) 1);
+	threadCond.notify_one();
+}
+
+void Appender::setFlushInterval(double seconds)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	interval = seconds;
+	threadCond.notify_one();
+}
+
+Appender::Stats Appender::getStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+} // filesystem
+} // lovewrap
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_APPENDER_H
+#define LOVEWRAP_APPENDER_H
+
+// STL
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// lovewrap
+#include "LOVEWrap.h"
+
+namespace lovewrap
+{
+namespace filesystem
+{
+
+// Appends to file in the save directory from a background thread. Unlike
+// filesystem::append, the file is kept open and writes only copy into memory
+// buffer, which is written when it's filled past the flush threshold, after
+// the flush interval, or on flush() and close().
+class Appender
+{
+public:
+	// What write() does when the buffer is full.
+	enum OverflowMode
+	{
+		OVERFLOW_BLOCK, // Wait until the background thread has written the buffer
+		OVERFLOW_DROP,  // Discard the write
+		OVERFLOW_MAX_ENUM
+	};
+
+	struct Stats
+	{
+		uint64_t writes;
+		uint64_t bytesWritten;  // Bytes written to the file
+		uint64_t dropped;       // Writes discarded because buffer was full
+		uint64_t droppedBytes;
+		uint64_t blocked;       // Writes which waited for space in buffer
+		uint64_t flushes;       // Times buffer was written to the file
+		uint64_t errors;        // Failed file writes. Their data is lost.
+	};
+
+	/**
+	 * Opens file for appending, creating it if it doesn't exist.
+	 * @param filename The file in the save directory.
+	 * @param bufferSize Buffer capacity, in bytes.
+	 * @param mode What to do when buffer is full.
+	 */
+	Appender(const std::string &filename, size_t bufferSize = 64 * 1024, OverflowMode mode = OVERFLOW_BLOCK);
+	// Writes remaining data and closes the file.
+	~Appender();
+
+	/**
+	 * Copies data into buffer.
+	 * @param data The data to append.
+	 * @param size The size in bytes of the data.
+	 * @return false if the write is dropped or the Appender is closed.
+	 */
+	bool write(const void *data, size_t size);
+	inline bool write(const std::string &str)
+	{
+		return write(str.c_str(), str.length());
+	}
+	/**
+	 * Writes buffered data to the file and waits until it's done.
+	 */
+	void flush();
+	/**
+	 * Writes remaining data, stops the background thread and closes the file.
+	 * Further writes are dropped.
+	 */
+	void close();
+	bool isOpen();
+
+	/**
+	 * Sets amount of buffered data which makes the background thread write it. Defaults to
+	 * half of the buffer size.
+	 * @param bytes Size in bytes.
+	 */
+	void setFlushThreshold(size_t bytes);
+	/**
+	 * Sets maximum time data stays in the buffer.
+	 * @param seconds Time in seconds. Defaults to 1 second.
+	 */
+	void setFlushInterval(double seconds);
+	Stats getStats();
+
+private:
+	Appender(const Appender&) = delete;
+	Appender &operator=(const Appender&) = delete;
+
+	void threadMain();
+
+	love::StrongRef<love::filesystem::File> file;
+	OverflowMode mode;
+	size_t capacity;
+	size_t threshold;
+	double interval;
+
+	// Filled by write(), swapped with writing by the background thread.
+	std::vector<char> pending;
+	std::vector<char> writing;
+	uint64_t appended;  // Total bytes put in pending
+	uint64_t flushed;   // Total bytes taken from pending by the thread
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable threadCond;
+	std::condition_variable spaceCond;
+	bool flushRequested;
+	bool closing;
+	bool closed;
+	Stats stats;
+};
+
+} // filesystem
+} // lovewrap
+
+#endif
@@ -0,0 +1,346 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// lovewrap
+#include "CommandList.h"
+#include "Job.h"
+
+namespace lovewrap
+{
+namespace graphics
+{
+
+// Submitted list. Submissions form a lock-free stack which replayCommands
+// takes as a whole, so workers never wait for the main thread.
+struct Submission
+{
+	std::vector<CommandList::Command> commands;
+	std::vector<love::StrongRef<love::Object>> objects;
+	Submission *next;
+};
+
+static std::atomic<Submission*> submissions(nullptr);
+
+static void push(Submission *s)
+{
+	s->next = submissions.load(std::memory_order_relaxed);
+	while (!submissions.compare_exchange_weak(s->next, s, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// Objects may be freed by releasing them, which must be done in the main
+// thread, so other threads hand them to replayCommands.
+static void discard(std::vector<love::StrongRef<love::Object>> &objects)
+{
+	if (objects.empty())
+		return;
+
+	if (job::isMainThread())
+	{
+		objects.clear();
+		return;
+	}
+
+	Submission *s = new Submission();
+	s->objects.swap(objects);
+	push(s);
+}
+
+CommandList::CommandList()
+: lastDrawable(nullptr)
+, lastQuad(nullptr)
+, key(0)
+, color(1.0f, 1.0f, 1.0f, 1.0f)
+, shader(nullptr)
+, blendMode(Graphics::BLEND_ALPHA)
+, blendAlpha(Graphics::BLENDALPHA_MULTIPLY)
+{
+}
+
+CommandList::~CommandList()
+{
+	setShader(nullptr);
+	discard(objects);
+}
+
+void CommandList::setSortKey(uint64_t key)
+{
+	this->key = key;
+}
+
+void CommandList::setColor(love::Colorf color)
+{
+	this->color = color;
+}
+
+void CommandList::setShader(Shader *shader)
+{
+	if (shader == this->shader)
+		return;
+
+	if (shader)
+		shader->retain();
+
+	// Recorded draws may use the old one, so it's released with them.
+	if (this->shader)
+		objects.push_back(love::StrongRef<love::Object>(this->shader, love::Acquire::NORETAIN));
+
+	this->shader = shader;
+}
+
+void CommandList::setBlendMode(Graphics::BlendMode blendMode, Graphics::BlendAlpha alphaMode)
+{
+	this->blendMode = blendMode;
+	blendAlpha = alphaMode;
+}
+
+void CommandList::retain(love::Object *object, love::Object *&last)
+{
+	// Consecutive draws usually use the same objects.
+	if (object == nullptr || object == last)
+		return;
+
+	objects.push_back(love::StrongRef<love::Object>(object));
+	last = object;
+}
+
+CommandList::Command &CommandList::add(Command::Type type)
+{
+	commands.push_back(Command());
+
+	Command &c = commands.back();
+	c.type = type;
+	c.drawMode = Graphics::DRAW_FILL;
+	c.key = key;
+	c.color = color;
+	c.shader = shader;
+	c.blendMode = blendMode;
+	c.blendAlpha = blendAlpha;
+	c.drawable = nullptr;
+	c.quad = nullptr;
+	return c;
+}
+
+void CommandList::draw(Drawable *drawable, float x, float y, float r, float sx, float sy, float ox, float oy, float kx, float ky)
+{
+	Command &c = add(Command::DRAW);
+	float params[9] = {x, y, r, sx, sy, ox, oy, kx, ky};
+
+	retain(drawable, lastDrawable);
+	c.drawable = drawable;
+	std::copy(params, params + 9, c.params);
+}
+
+void CommandList::draw(Texture *texture, Quad *quad, float x, float y, float r, float sx, float sy, float ox, float oy, float kx, float ky)
+{
+	Command &c = add(Command::DRAW_QUAD);
+	float params[9] = {x, y, r, sx, sy, ox, oy, kx, ky};
+
+	retain(texture, lastDrawable);
+	retain(quad, lastQuad);
+	c.drawable = texture;
+	c.quad = quad;
+	std::copy(params, params + 9, c.params);
+}
+
+void CommandList::rectangle(Graphics::DrawMode mode, float x, float y, float w, float h)
+{
+	Command &c = add(Command::RECTANGLE);
+	c.drawMode = mode;
+	c.params[0] = x;
+	c.params[1] = y;
+	c.params[2] = w;
+	c.params[3] = h;
+}
+
+void CommandList::submit()
+{
+	if (commands.empty())
+		return;
+
+	Submission *s = new Submission();
+	s->commands.swap(commands);
+	s->objects.swap(objects);
+	lastDrawable = lastQuad = nullptr;
+
+	// The list keeps its reference for the following draws.
+	if (shader)
+		s->objects.push_back(love::StrongRef<love::Object>(shader));
+
+	push(s);
+}
+
+void CommandList::clear()
+{
+	commands.clear();
+	discard(objects);
+	lastDrawable = lastQuad = nullptr;
+}
+
+size_t CommandList::getCount() const
+{
+	return commands.size();
+}
+
+// Lists of getCommandList. They're owned here rather than by thread_local, so
+// deinitializeCommands frees them in the main thread before LOVE is gone.
+static std::vector<std::unique_ptr<CommandList>> threadLists;
+static std::mutex threadListMutex;
+static std::atomic<unsigned int> threadListGeneration(0);
+
+CommandList &getCommandList()
+{
+	struct Local
+	{
+		CommandList *list;
+		unsigned int generation;
+	};
+
+	static thread_local Local local = {nullptr, 0};
+	unsigned int generation = threadListGeneration.load();
+
+	if (local.list == nullptr || local.generation != generation)
+	{
+		std::lock_guard<std::mutex> lock(threadListMutex);
+		threadLists.push_back(std::unique_ptr<CommandList>(new CommandList()));
+		local.list = threadLists.back().get();
+		local.generation = generation;
+	}
+
+	return *local.list;
+}
+
+void deinitializeCommands()
+{
+	if (!job::isMainThread())
+		throw love::Exception("Commands can only be deinitialized in the main thread.");
+
+	std::vector<std::unique_ptr<CommandList>> lists;
+
+	{
+		std::lock_guard<std::mutex> lock(threadListMutex);
+		lists.swap(threadLists);
+		threadListGeneration++;
+	}
+
+	// Destroyed lists hand their objects to the submissions, so those are freed last.
+	lists.clear();
+
+	Submission *s = submissions.exchange(nullptr, std::memory_order_acquire);
+	while (s)
+	{
+		std::unique_ptr<Submission> owner(s);
+		s = s->next;
+	}
+}
+
+static bool equalColor(const love::Colorf &a, const love::Colorf &b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+size_t replayCommands()
+{
+	if (!job::isMainThread())
+		throw love::Exception("Commands can only be replayed in the main thread.");
+
+	Submission *head = submissions.exchange(nullptr, std::memory_order_acquire);
+	std::vector<std::unique_ptr<Submission>> list;
+
+	// The stack is newest first.
+	for (Submission *s = head; s; s = s->next)
+		list.push_back(std::unique_ptr<Submission>(s));
+
+	std::reverse(list.begin(), list.end());
+
+	std::vector<const CommandList::Command*> order;
+	for (std::unique_ptr<Submission> &s: list)
+	{
+		for (const CommandList::Command &c: s->commands)
+			order.push_back(&c);
+	}
+
+	std::stable_sort(order.begin(), order.end(), [](const CommandList::Command *a, const CommandList::Command *b)
+	{
+		return a->key < b->key;
+	});
+
+	// Only changed state is set.
+	Graphics::BlendAlpha oldBlendAlpha;
+	Graphics::BlendMode oldBlendMode = getBlendMode(oldBlendAlpha);
+	love::Colorf oldColor = getInstance()->getColor();
+	love::StrongRef<Shader> oldShader(getInstance()->getShader());
+
+	love::Colorf color = oldColor;
+	Shader *shader = oldShader.get();
+	Graphics::BlendMode blendMode = oldBlendMode;
+	Graphics::BlendAlpha blendAlpha = oldBlendAlpha;
+
+	for (const CommandList::Command *c: order)
+	{
+		if (!equalColor(c->color, color))
+		{
+			color = c->color;
+			setColor(color);
+		}
+
+		if (c->shader != shader)
+		{
+			shader = c->shader;
+			setShader(shader);
+		}
+
+		if (c->blendMode != blendMode || c->blendAlpha != blendAlpha)
+		{
+			blendMode = c->blendMode;
+			blendAlpha = c->blendAlpha;
+			setBlendMode(blendMode, blendAlpha);
+		}
+
+		const float *p = c->params;
+
+		switch (c->type)
+		{
+		case CommandList::Command::DRAW:
+			draw(c->drawable, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+			break;
+		case CommandList::Command::DRAW_QUAD:
+			draw(static_cast<Texture*>(c->drawable), c->quad, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+			break;
+		case CommandList::Command::RECTANGLE:
+			rectangle(c->drawMode, p[0], p[1], p[2], p[3]);
+			break;
+		}
+	}
+
+	setColor(oldColor);
+	setShader(oldShader.get());
+	setBlendMode(oldBlendMode, oldBlendAlpha);
+
+	return order.size();
+}
+
+} // graphics
+} // lovewrap
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_COMMANDLIST_H
+#define LOVEWRAP_COMMANDLIST_H
+
+// STL
+#include <cstdint>
+#include <vector>
+
+// lovewrap
+#include "LOVEWrap.h"
+
+namespace lovewrap
+{
+namespace graphics
+{
+
+// Records draw calls from any thread, to be replayed in the main thread by
+// replayCommands. Each draw keeps the color, shader, blend mode and sort key
+// that were set when it was recorded, so lists from different threads can be
+// merged and sorted freely.
+class CommandList
+{
+public:
+	CommandList();
+	~CommandList();
+
+	/**
+	 * Sets sort key of following draws. Draws are replayed in order of sort key, then in order
+	 * of submission and recording.
+	 * @param key The sort key. Defaults to 0.
+	 */
+	void setSortKey(uint64_t key);
+	void setColor(love::Colorf color);
+	inline void setColor(float r, float g, float b, float a = 1.0f)
+	{
+		setColor(love::Colorf(r, g, b, a));
+	}
+	// The shader is retained until it's replaced and the draws using it are replayed. nullptr
+	// means default shader.
+	void setShader(Shader *shader = nullptr);
+	void setBlendMode(Graphics::BlendMode blendMode, Graphics::BlendAlpha alphaMode = Graphics::BLENDALPHA_MULTIPLY);
+
+	// Same as graphics::draw. Objects are retained until they're replayed.
+	void draw(Drawable *drawable, float x = 0.0f, float y = 0.0f, float r = 0.0f, float sx = 1.0f, float sy = 1.0f, float ox = 0.0f, float oy = 0.0f, float kx = 0.0f, float ky = 0.0f);
+	void draw(Texture *texture, Quad *quad, float x = 0.0f, float y = 0.0f, float r = 0.0f, float sx = 1.0f, float sy = 1.0f, float ox = 0.0f, float oy = 0.0f, float kx = 0.0f, float ky = 0.0f);
+	void rectangle(Graphics::DrawMode mode, float x, float y, float w, float h);
+
+	/**
+	 * Queues recorded draws for replayCommands and empties the list. The state (color, shader,
+	 * blend mode and sort key) is kept. Doesn't wait for the main thread.
+	 */
+	void submit();
+	// Discards recorded draws. Outside of the main thread, the objects they use are released by
+	// the next replayCommands, as are those of a destroyed list.
+	void clear();
+	size_t getCount() const;
+
+	// Recorded draw. Only used internally.
+	struct Command
+	{
+		enum Type
+		{
+			DRAW,
+			DRAW_QUAD,
+			RECTANGLE
+		};
+
+		Type type;
+		Graphics::DrawMode drawMode;
+		uint64_t key;
+		love::Colorf color;
+		Shader *shader;
+		Graphics::BlendMode blendMode;
+		Graphics::BlendAlpha blendAlpha;
+		Drawable *drawable;
+		Quad *quad;
+		float params[9];
+	};
+
+private:
+	CommandList(const CommandList&) = delete;
+	CommandList &operator=(const CommandList&) = delete;
+
+	Command &add(Command::Type type);
+	// Keeps object alive until replay. Skipped if it's the same as last.
+	void retain(love::Object *object, love::Object *&last);
+
+	std::vector<Command> commands;
+	// Released in the main thread only.
+	std::vector<love::StrongRef<love::Object>> objects;
+	// Last retained drawable or texture, and quad.
+	love::Object *lastDrawable;
+	love::Object *lastQuad;
+
+	uint64_t key;
+	love::Colorf color;
+	// Retained by the list.
+	Shader *shader;
+	Graphics::BlendMode blendMode;
+	Graphics::BlendAlpha blendAlpha;
+};
+
+/**
+ * Gets command list of the calling thread. The lists are kept until deinitializeCommands.
+ */
+CommandList &getCommandList();
+/**
+ * Frees lists of getCommandList and discards submitted commands without drawing them, releasing
+ * the objects they use. Called by runGame in the main thread after workers are stopped and
+ * before the Lua state is closed.
+ */
+void deinitializeCommands();
+/**
+ * Draws all submitted commands, sorted by key, then restores color, shader and blend mode.
+ * Must be called from the main thread, e.g. in Scene::draw.
+ * @return Amount of commands drawn.
+ */
+size_t replayCommands();
+
+} // graphics
+} // lovewrap
+
+#endif
@@ -0,0 +1,465 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+#include <exception>
+#include <mutex>
+
+// LOVE
+#include "common/Exception.h"
+
+// lovewrap
+#include "ECS.h"
+#include "Job.h"
+#include "LOVEWrap.h"
+#include "Profiler.h"
+
+namespace lovewrap
+{
+namespace ecs
+{
+
+static ComponentInfo componentInfos[MAX_COMPONENTS];
+static ComponentID componentCount = 0;
+static std::mutex componentMutex;
+
+ComponentID registerComponent(const ComponentInfo &info)
+{
+	std::lock_guard<std::mutex> lock(componentMutex);
+
+	if (componentCount >= MAX_COMPONENTS)
+		throw love::Exception("Too many component types (max %d).", (int) MAX_COMPONENTS);
+
+	componentInfos[componentCount] = info;
+	return componentCount++;
+}
+
+const ComponentInfo &getComponentInfo(ComponentID id)
+{
+	return componentInfos[id];
+}
+
+static size_t alignUp(size_t value, size_t align)
+{
+	return (value + align - 1) / align * align;
+}
+
+Archetype::Archetype(const ComponentMask &mask)
+: mask(mask)
+, capacity(0)
+, chunkBytes(CHUNK_SIZE)
+{
+	std::fill(addEdges, addEdges + MAX_COMPONENTS, nullptr);
+	std::fill(removeEdges, removeEdges + MAX_COMPONENTS, nullptr);
+	std::fill(offsets, offsets + MAX_COMPONENTS, -1);
+
+	size_t rowSize = sizeof(Entity);
+	for (ComponentID i = 0; i < MAX_COMPONENTS; i++)
+	{
+		if (mask.test(i))
+		{
+			components.push_back(i);
+			rowSize += getComponentInfo(i).size;
+		}
+	}
+
+	// Shrink until the arrays fit with alignment padding.
+	capacity = std::max(CHUNK_SIZE / rowSize, (size_t) 1);
+	for (;;)
+	{
+		size_t offset = sizeof(Entity) * capacity;
+
+		for (ComponentID id: components)
+		{
+			const ComponentInfo &info = getComponentInfo(id);
+			offset = alignUp(offset, info.align);
+			offsets[id] = (ptrdiff_t) offset;
+			offset += info.size * capacity;
+		}
+
+		// Larger than CHUNK_SIZE only when a single row doesn't fit.
+		chunkBytes = std::max(offset, CHUNK_SIZE);
+
+		if (offset <= CHUNK_SIZE || capacity == 1)
+			break;
+
+		capacity--;
+	}
+}
+
+Archetype::~Archetype()
+{
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		for (ComponentID id: components)
+		{
+			const ComponentInfo &info = getComponentInfo(id);
+			char *array = (char *) getComponents(c, id);
+
+			for (size_t i = 0; i < chunks[c].count; i++)
+				info.destroy(array + info.size * i);
+		}
+	}
+}
+
+const ComponentMask &Archetype::getMask() const
+{
+	return mask;
+}
+
+size_t Archetype::getCapacity() const
+{
+	return capacity;
+}
+
+size_t Archetype::getChunkCount() const
+{
+	return chunks.size();
+}
+
+size_t Archetype::getCount(size_t chunk) const
+{
+	return chunks[chunk].count;
+}
+
+size_t Archetype::getEntityCount() const
+{
+	return chunks.empty() ? 0 : (chunks.size() - 1) * capacity + chunks.back().count;
+}
+
+Entity *Archetype::getEntities(size_t chunk)
+{
+	return (Entity *) chunks[chunk].data.get();
+}
+
+void *Archetype::getComponents(size_t chunk, ComponentID id)
+{
+	if (offsets[id] < 0)
+		return nullptr;
+
+	return chunks[chunk].data.get() + offsets[id];
+}
+
+void Archetype::allocate(Entity entity, size_t &chunk, size_t &row)
+{
+	if (chunks.empty() || chunks.back().count == capacity)
+	{
+		Chunk c;
+		c.data.reset(new unsigned char[chunkBytes]);
+		c.count = 0;
+		chunks.push_back(std::move(c));
+	}
+
+	chunk = chunks.size() - 1;
+	row = chunks.back().count++;
+	getEntities(chunk)[row] = entity;
+}
+
+Entity Archetype::release(size_t chunk, size_t row)
+{
+	size_t lastChunk = chunks.size() - 1;
+	size_t lastRow = chunks.back().count - 1;
+	Entity moved = NULL_ENTITY;
+
+	if (chunk != lastChunk || row != lastRow)
+	{
+		for (ComponentID id: components)
+			getComponentInfo(id).move(getComponent(chunk, row, id), getComponent(lastChunk, lastRow, id));
+
+		moved = getEntities(lastChunk)[lastRow];
+		getEntities(chunk)[row] = moved;
+	}
+
+	if (--chunks.back().count == 0)
+		chunks.pop_back();
+
+	return moved;
+}
+
+World::World()
+: entityCount(0)
+{
+	// Index 0 is the null entity.
+	Record r = {nullptr, 0, 0, 0};
+	records.push_back(r);
+}
+
+World::~World()
+{
+	// Archetypes destroy their components.
+}
+
+Entity World::allocateEntity()
+{
+	Entity e;
+
+	if (freeList.empty())
+	{
+		Record r = {nullptr, 0, 0, 1};
+		e.index = (uint32_t) records.size();
+		records.push_back(r);
+	}
+	else
+	{
+		e.index = freeList.back();
+		freeList.pop_back();
+	}
+
+	e.generation = records[e.index].generation;
+	entityCount++;
+	return e;
+}
+
+void World::setRecord(Entity e, Archetype *archetype, size_t chunk, size_t row)
+{
+	Record &r = records[e.index];
+	r.archetype = archetype;
+	r.chunk = (uint32_t) chunk;
+	r.row = (uint32_t) row;
+}
+
+ComponentMask World::getRecordMask(Entity e) const
+{
+	return records[e.index].archetype->getMask();
+}
+
+void World::freeRow(const Record &r, bool destroyComponents)
+{
+	Archetype *a = r.archetype;
+
+	if (destroyComponents)
+	{
+		for (ComponentID id = 0; id < MAX_COMPONENTS; id++)
+		{
+			if (a->getMask().test(id))
+				getComponentInfo(id).destroy(a->getComponent(r.chunk, r.row, id));
+		}
+	}
+
+	Entity moved = a->release(r.chunk, r.row);
+	if (moved != NULL_ENTITY)
+		setRecord(moved, a, r.chunk, r.row);
+}
+
+void World::destroy(Entity e)
+{
+	if (!isAlive(e))
+		return;
+
+	Record r = records[e.index];
+	freeRow(r, true);
+
+	Record &dead = records[e.index];
+	dead.archetype = nullptr;
+	// Skip 0 on wrap around, it's the null generation.
+	dead.generation = dead.generation + 1 == 0 ? 1 : dead.generation + 1;
+	freeList.push_back(e.index);
+	entityCount--;
+}
+
+bool World::isAlive(Entity e) const
+{
+	return e.index > 0 && e.index < records.size() && records[e.index].generation == e.generation && records[e.index].archetype != nullptr;
+}
+
+void World::checkAlive(Entity e) const
+{
+	if (!isAlive(e))
+		throw love::Exception("Entity %u (generation %u) is not alive.", e.index, e.generation);
+}
+
+size_t World::getEntityCount() const
+{
+	return entityCount;
+}
+
+void *World::getComponent(Entity e, ComponentID id)
+{
+	if (!isAlive(e))
+		return nullptr;
+
+	const Record &r = records[e.index];
+	if (!r.archetype->getMask().test(id))
+		return nullptr;
+
+	return r.archetype->getComponent(r.chunk, r.row, id);
+}
+
+Archetype *World::getArchetype(const ComponentMask &mask)
+{
+	std::unique_ptr<Archetype> &a = archetypeMap[mask];
+
+	if (!a)
+	{
+		a.reset(new Archetype(mask));
+		archetypes.push_back(a.get());
+	}
+
+	return a.get();
+}
+
+void World::move(Entity e, const ComponentMask &mask, ComponentID id, bool adding)
+{
+	Record old = records[e.index];
+	Archetype *&edge = adding ? old.archetype->addEdges[id] : old.archetype->removeEdges[id];
+
+	if (edge == nullptr)
+		edge = getArchetype(mask);
+
+	Archetype *target = edge;
+	size_t chunk, row;
+	target->allocate(e, chunk, row);
+
+	for (ComponentID i = 0; i < MAX_COMPONENTS; i++)
+	{
+		if (!old.archetype->getMask().test(i))
+			continue;
+
+		const ComponentInfo &info = getComponentInfo(i);
+		void *src = old.archetype->getComponent(old.chunk, old.row, i);
+
+		if (mask.test(i))
+			info.move(target->getComponent(chunk, row, i), src);
+		else
+			info.destroy(src);
+	}
+
+	freeRow(old, false);
+	setRecord(e, target, chunk, row);
+}
+
+const std::vector<Archetype*> &World::getArchetypes() const
+{
+	return archetypes;
+}
+
+Scheduler::Scheduler()
+: stagesDirty(false)
+, parallel(true)
+{
+}
+
+void Scheduler::add(const char *name, const ComponentMask &reads, const ComponentMask &writes, Function func)
+{
+	System s = {name, reads, writes, func};
+	systems.push_back(s);
+	stagesDirty = true;
+}
+
+void Scheduler::buildStages()
+{
+	// Each system goes to the stage after the last one with a conflicting system,
+	// so conflicting systems keep their order.
+	std::vector<size_t> stageOf(systems.size());
+	stages.clear();
+
+	for (size_t i = 0; i < systems.size(); i++)
+	{
+		size_t stage = 0;
+
+		for (size_t j = 0; j < i; j++)
+		{
+			const System &a = systems[i], &b = systems[j];
+			bool conflict = (a.writes & (b.reads | b.writes)).any() || (b.writes & a.reads).any();
+
+			if (conflict)
+				stage = std::max(stage, stageOf[j] + 1);
+		}
+
+		stageOf[i] = stage;
+		if (stages.size() <= stage)
+			stages.resize(stage + 1);
+
+		stages[stage].push_back(i);
+	}
+
+	stagesDirty = false;
+}
+
+void Scheduler::runSystem(System &system, World &world, float dt)
+{
+	LOVEWRAP_PROFILE_SCOPE(system.name);
+	system.func(world, dt);
+}
+
+void Scheduler::run(World &world, float dt)
+{
+	if (stagesDirty)
+		buildStages();
+
+	bool useWorkers = parallel && job::getWorkerCount() > 0;
+
+	for (const std::vector<size_t> &stage: stages)
+	{
+		if (!useWorkers || stage.size() == 1)
+		{
+			for (size_t i: stage)
+				runSystem(systems[i], world, dt);
+
+			continue;
+		}
+
+		job::Fence fence;
+		std::exception_ptr exception;
+
+		for (size_t k = 1; k < stage.size(); k++)
+		{
+			System *system = &systems[stage[k]];
+			fence.run([this, system, &world, dt]() {runSystem(*system, world, dt);});
+		}
+
+		try
+		{
+			runSystem(systems[stage[0]], world, dt);
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+
+		// The systems reference world, so wait for them even if this one threw.
+		try
+		{
+			fence.wait();
+		}
+		catch (...)
+		{
+			if (!exception)
+				exception = std::current_exception();
+		}
+
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+}
+
+void Scheduler::setParallel(bool enable)
+{
+	parallel = enable;
+}
+
+bool Scheduler::isParallel() const
+{
+	return parallel;
+}
+
+} // ecs
+} // lovewrap
@@ -0,0 +1,446 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_ECS_H
+#define LOVEWRAP_ECS_H
+
+// STL
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lovewrap
+{
+
+// Entity component store. Entities with the same set of components (an
+// archetype) are stored together in fixed size chunks, with each component
+// type in its own contiguous array, so queries walk plain arrays.
+namespace ecs
+{
+
+const size_t MAX_COMPONENTS = 64;
+// Bytes per chunk, including the entity array.
+const size_t CHUNK_SIZE = 16 * 1024;
+
+typedef uint32_t ComponentID;
+typedef std::bitset<MAX_COMPONENTS> ComponentMask;
+
+struct Entity
+{
+	uint32_t index;
+	uint32_t generation; // 0 is never used, so Entity{0, 0} is null
+
+	bool operator==(const Entity &o) const { return index == o.index && generation == o.generation; }
+	bool operator!=(const Entity &o) const { return !(*this == o); }
+};
+
+const Entity NULL_ENTITY = {0, 0};
+
+struct ComponentInfo
+{
+	size_t size;
+	size_t align;
+	// Move constructs dst from src, then destroys src.
+	void (*move)(void *dst, void *src);
+	void (*destroy)(void *p);
+};
+
+/**
+ * Registers component type. Use getComponentID instead.
+ * @return ID of the component. Throws love::Exception past MAX_COMPONENTS.
+ */
+ComponentID registerComponent(const ComponentInfo &info);
+const ComponentInfo &getComponentInfo(ComponentID id);
+
+namespace detail
+{
+
+template<typename T>
+void moveComponent(void *dst, void *src)
+{
+	new (dst) T(std::move(*(T *) src));
+	((T *) src)->~T();
+}
+
+template<typename T>
+void destroyComponent(void *p)
+{
+	((T *) p)->~T();
+}
+
+template<typename T>
+ComponentID getID()
+{
+	static_assert(alignof(T) <= alignof(std::max_align_t), "Component alignment is too large.");
+
+	static const ComponentID id = ecs::registerComponent({sizeof(T), alignof(T), &moveComponent<T>, &destroyComponent<T>});
+	return id;
+}
+
+} // detail
+
+/**
+ * Gets ID of component type, registering it on first use. Const is ignored.
+ */
+template<typename T>
+ComponentID getComponentID()
+{
+	return detail::getID<typename std::remove_cv<T>::type>();
+}
+
+template<typename... Ts>
+ComponentMask makeMask()
+{
+	ComponentMask mask;
+	int expand[] = {0, (mask.set(getComponentID<Ts>()), 0)...};
+	(void) expand;
+	return mask;
+}
+
+// Entities with the same components. Chunks are kept full except the last one.
+class Archetype
+{
+public:
+	Archetype(const ComponentMask &mask);
+	~Archetype();
+
+	const ComponentMask &getMask() const;
+	// Entities per chunk
+	size_t getCapacity() const;
+	size_t getChunkCount() const;
+	// Amount of entities in chunk
+	size_t getCount(size_t chunk) const;
+	size_t getEntityCount() const;
+	Entity *getEntities(size_t chunk);
+	/**
+	 * Gets component array of chunk.
+	 * @return Pointer to the array, or nullptr if the archetype doesn't have the component.
+	 */
+	void *getComponents(size_t chunk, ComponentID id);
+
+	template<typename T>
+	T *getComponents(size_t chunk)
+	{
+		return (T *) getComponents(chunk, getComponentID<T>());
+	}
+
+	inline void *getComponent(size_t chunk, size_t row, ComponentID id)
+	{
+		return (char *) getComponents(chunk, id) + getComponentInfo(id).size * row;
+	}
+
+	// Used by World. Components of the new row are left uninitialized.
+	void allocate(Entity entity, size_t &chunk, size_t &row);
+	/**
+	 * Removes row, moving the last entity into it. Components must be destroyed or moved
+	 * out already.
+	 * @return The moved entity, or NULL_ENTITY if the row was the last one.
+	 */
+	Entity release(size_t chunk, size_t row);
+
+	Archetype *addEdges[MAX_COMPONENTS];
+	Archetype *removeEdges[MAX_COMPONENTS];
+
+private:
+	Archetype(const Archetype&) = delete;
+	Archetype &operator=(const Archetype&) = delete;
+
+	struct Chunk
+	{
+		std::unique_ptr<unsigned char[]> data;
+		size_t count;
+	};
+
+	ComponentMask mask;
+	std::vector<ComponentID> components;
+	// Offset of each component array in chunk, -1 if not in this archetype.
+	ptrdiff_t offsets[MAX_COMPONENTS];
+	size_t capacity;
+	size_t chunkBytes;
+	std::vector<Chunk> chunks;
+};
+
+class World
+{
+public:
+	World();
+	// Destroys all entities.
+	~World();
+
+	/**
+	 * Creates entity with components.
+	 * @param components Components, of distinct types.
+	 * @return The entity.
+	 */
+	template<typename... Ts>
+	Entity create(Ts&&... components)
+	{
+		size_t chunk, row;
+		Entity e = allocateEntity();
+		Archetype *archetype = getArchetype(makeMask<typename std::decay<Ts>::type...>());
+
+		archetype->allocate(e, chunk, row);
+		setRecord(e, archetype, chunk, row);
+
+		int expand[] = {0, (construct(archetype, chunk, row, std::forward<Ts>(components)), 0)...};
+		(void) expand;
+		return e;
+	}
+
+	void destroy(Entity e);
+	bool isAlive(Entity e) const;
+	size_t getEntityCount() const;
+
+	template<typename T>
+	bool has(Entity e) const
+	{
+		return isAlive(e) && records[e.index].archetype->getMask().test(getComponentID<T>());
+	}
+
+	/**
+	 * Gets component of entity. The pointer is valid until components are added to or
+	 * removed from any entity of the same archetype.
+	 * @return The component, or nullptr if the entity doesn't have it.
+	 */
+	template<typename T>
+	T *get(Entity e)
+	{
+		return (T *) getComponent(e, getComponentID<T>());
+	}
+
+	/**
+	 * Adds component to entity, or replaces the existing one. Throws love::Exception if the
+	 * entity isn't alive.
+	 */
+	template<typename T>
+	void add(Entity e, T &&component)
+	{
+		typedef typename std::decay<T>::type U;
+		ComponentID id = getComponentID<U>();
+		checkAlive(e);
+		U *existing = (U *) getComponent(e, id);
+
+		if (existing)
+		{
+			*existing = std::forward<T>(component);
+			return;
+		}
+
+		ComponentMask mask = getRecordMask(e);
+		mask.set(id);
+		move(e, mask, id, true);
+
+		const Record &r = records[e.index];
+		new (r.archetype->getComponent(r.chunk, r.row, id)) U(std::forward<T>(component));
+	}
+
+	// Throws love::Exception if the entity isn't alive.
+	template<typename T>
+	void remove(Entity e)
+	{
+		ComponentID id = getComponentID<T>();
+		checkAlive(e);
+
+		if (!getComponent(e, id))
+			return;
+
+		ComponentMask mask = getRecordMask(e);
+		mask.reset(id);
+		move(e, mask, id, false);
+	}
+
+	// Archetypes in order of creation. Used by Query.
+	const std::vector<Archetype*> &getArchetypes() const;
+
+private:
+	World(const World&) = delete;
+	World &operator=(const World&) = delete;
+
+	struct Record
+	{
+		Archetype *archetype;
+		uint32_t chunk;
+		uint32_t row;
+		uint32_t generation;
+	};
+
+	template<typename T>
+	void construct(Archetype *archetype, size_t chunk, size_t row, T &&component)
+	{
+		typedef typename std::decay<T>::type U;
+		new (archetype->getComponent(chunk, row, getComponentID<U>())) U(std::forward<T>(component));
+	}
+
+	Entity allocateEntity();
+	// Throws love::Exception if the entity isn't alive, e.g. destroyed and its index reused.
+	void checkAlive(Entity e) const;
+	void setRecord(Entity e, Archetype *archetype, size_t chunk, size_t row);
+	ComponentMask getRecordMask(Entity e) const;
+	void *getComponent(Entity e, ComponentID id);
+	Archetype *getArchetype(const ComponentMask &mask);
+	// Moves entity to archetype of mask, which differs by component id. Components
+	// which aren't in the new archetype are destroyed.
+	void move(Entity e, const ComponentMask &mask, ComponentID id, bool adding);
+	// Destroys components and frees the row of entity.
+	void freeRow(const Record &r, bool destroyComponents);
+
+	std::vector<Record> records;
+	std::vector<uint32_t> freeList;
+	std::unordered_map<ComponentMask, std::unique_ptr<Archetype>> archetypeMap;
+	std::vector<Archetype*> archetypes;
+	size_t entityCount;
+};
+
+// Iterates entities which have all of Ts. Const component types are read only,
+// which the scheduler uses to run systems in parallel.
+template<typename... Ts>
+class Query
+{
+public:
+	static ComponentMask getMask()
+	{
+		return makeMask<Ts...>();
+	}
+
+	static ComponentMask getReadMask()
+	{
+		ComponentMask mask;
+		int expand[] = {0, (std::is_const<Ts>::value ? (mask.set(getComponentID<Ts>()), 0) : 0)...};
+		(void) expand;
+		return mask;
+	}
+
+	static ComponentMask getWriteMask()
+	{
+		return getMask() & ~getReadMask();
+	}
+
+	/**
+	 * Calls func(count, entities, arrays...) for each chunk of matching entities.
+	 */
+	template<typename F>
+	static void forEachChunk(World &world, F func)
+	{
+		ComponentMask mask = getMask();
+
+		for (Archetype *a: world.getArchetypes())
+		{
+			if ((a->getMask() & mask) != mask)
+				continue;
+
+			for (size_t c = 0; c < a->getChunkCount(); c++)
+				func(a->getCount(c), a->getEntities(c), a->template getComponents<Ts>(c)...);
+		}
+	}
+
+	/**
+	 * Calls func(components...) for each matching entity.
+	 */
+	template<typename F>
+	static void forEach(World &world, F func)
+	{
+		forEachChunk(world, Rows<F>{func});
+	}
+
+private:
+	template<typename F>
+	struct Rows
+	{
+		F &func;
+
+		void operator()(size_t count, Entity*, Ts*... arrays) const
+		{
+			for (size_t i = 0; i < count; i++)
+				func(arrays[i]...);
+		}
+	};
+};
+
+// Runs systems in the order they're added, except that systems whose
+// components don't conflict (one writes what another reads or writes) run at
+// the same time on the worker threads. Systems must not create or destroy
+// entities or add or remove components.
+class Scheduler
+{
+public:
+	typedef std::function<void(World&, float)> Function;
+
+	Scheduler();
+
+	/**
+	 * Adds system.
+	 * @param name Name shown in the profiler. The pointer is stored as-is, like profiler::record.
+	 * @param reads Components the system reads.
+	 * @param writes Components the system writes.
+	 * @param func The system, called with the world and delta time.
+	 */
+	void add(const char *name, const ComponentMask &reads, const ComponentMask &writes, Function func);
+	/**
+	 * Adds system which calls func(dt, components...) for each entity with all of Ts.
+	 * Const types are read, others are written.
+	 */
+	template<typename... Ts, typename F>
+	void add(const char *name, F func)
+	{
+		add(name, Query<Ts...>::getReadMask(), Query<Ts...>::getWriteMask(), [func](World &world, float dt) mutable
+		{
+			Query<Ts...>::forEach(world, [&func, dt](Ts&... components) {func(dt, components...);});
+		});
+	}
+
+	/**
+	 * Runs all systems and waits for them. Call it from Scene::update.
+	 * @param world The world.
+	 * @param dt Delta time, in seconds.
+	 */
+	void run(World &world, float dt);
+	void setParallel(bool enable);
+	bool isParallel() const;
+
+private:
+	struct System
+	{
+		const char *name;
+		ComponentMask reads;
+		ComponentMask writes;
+		Function func;
+	};
+
+	void buildStages();
+	void runSystem(System &system, World &world, float dt);
+
+	std::vector<System> systems;
+	// Indices to systems, which can run at the same time.
+	std::vector<std::vector<size_t>> stages;
+	bool stagesDirty;
+	bool parallel;
+};
+
+} // ecs
+} // lovewrap
+
+#endif
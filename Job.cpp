@@ -0,0 +1,808 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// lovewrap
+#include "LOVEWrap.h"
+#include "Job.h"
+#include "Profiler.h"
+
+namespace lovewrap
+{
+namespace job
+{
+
+static std::thread::id mainThreadID = std::this_thread::get_id();
+
+// Each worker has its own queue. The owner takes from the back, other workers
+// steal from the front.
+struct Worker
+{
+	std::thread thread;
+	std::deque<std::function<void()>> queue;
+	std::mutex mutex;
+
+	// Since last endFrame
+	std::atomic<uint64_t> tasks;
+	std::atomic<uint64_t> steals;
+	std::atomic<uint64_t> busyMicros;
+};
+
+static std::vector<std::unique_ptr<Worker>> workers;
+// Tasks started outside of workers.
+static std::deque<std::function<void()>> injectQueue;
+static std::mutex workerMutex;
+static std::condition_variable workerCond;
+// Tasks queued in any queue.
+static std::atomic<size_t> pendingTasks(0);
+static std::atomic<bool> stopping(false);
+static thread_local int workerIndex = -1;
+
+// Main thread lane
+struct MainTask
+{
+	std::function<void()> task;
+	// Called instead of the task if it's discarded when stopping.
+	std::function<void()> cancel;
+};
+
+static std::deque<MainTask> mainQueue;
+static std::mutex mainMutex;
+static std::condition_variable mainNotFull;
+static std::condition_variable mainNotEmpty;
+static size_t mainQueueSize = 64;
+static double mainThreadBudget = 0.002;
+
+static Stats stats = {0, 0, 0, 0.0, 0.0};
+static double lastFrameTime = -1.0;
+
+static void startWorkers(int count);
+
+static void push(std::function<void()> task)
+{
+	// Workers started now would never be joined.
+	if (stopping)
+	{
+		task();
+		return;
+	}
+
+	if (workers.empty())
+		startWorkers(0);
+
+	// Counted first, so it can't drop below zero when the task is taken right away.
+	pendingTasks++;
+
+	if (workerIndex >= 0)
+	{
+		Worker &w = *workers[workerIndex];
+		std::lock_guard<std::mutex> lock(w.mutex);
+		w.queue.push_back(std::move(task));
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(workerMutex);
+		injectQueue.push_back(std::move(task));
+	}
+
+	{
+		// So workers can't miss it between checking and waiting.
+		std::lock_guard<std::mutex> lock(workerMutex);
+	}
+
+	workerCond.notify_one();
+}
+
+static bool popFront(std::deque<std::function<void()>> &queue, std::mutex &mutex, std::function<void()> &task)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (queue.empty())
+		return false;
+
+	task = std::move(queue.front());
+	queue.pop_front();
+	return true;
+}
+
+// Takes task from own queue, then the shared queue, then other workers.
+static bool takeTask(std::function<void()> &task, bool &stolen)
+{
+	stolen = false;
+
+	if (pendingTasks == 0)
+		return false;
+
+	if (workerIndex >= 0)
+	{
+		Worker &w = *workers[workerIndex];
+		std::lock_guard<std::mutex> lock(w.mutex);
+
+		if (!w.queue.empty())
+		{
+			task = std::move(w.queue.back());
+			w.queue.pop_back();
+			pendingTasks--;
+			return true;
+		}
+	}
+
+	if (popFront(injectQueue, workerMutex, task))
+	{
+		pendingTasks--;
+		return true;
+	}
+
+	size_t count = workers.size();
+	size_t start = workerIndex >= 0 ? (size_t) workerIndex + 1 : 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t victim = (start + i) % count;
+		if ((int) victim == workerIndex)
+			continue;
+
+		if (popFront(workers[victim]->queue, workers[victim]->mutex, task))
+		{
+			pendingTasks--;
+			stolen = true;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Runs one queued task, if any. Used by threads waiting for tasks to finish.
+static bool runPendingTask()
+{
+	std::function<void()> task;
+	bool stolen;
+
+	if (!takeTask(task, stolen))
+		return false;
+
+	task();
+	return true;
+}
+
+static void workerMain(int index)
+{
+	workerIndex = index;
+	Worker &w = *workers[index];
+
+	for (;;)
+	{
+		std::function<void()> task;
+		bool stolen;
+
+		if (!takeTask(task, stolen))
+		{
+			std::unique_lock<std::mutex> lock(workerMutex);
+			workerCond.wait(lock, []() {return stopping || pendingTasks > 0;});
+
+			if (stopping)
+				return;
+
+			continue;
+		}
+
+		double start = timer::getTime();
+		task();
+		double end = timer::getTime();
+
+		profiler::record("job", start, end);
+		w.tasks.fetch_add(1, std::memory_order_relaxed);
+		w.busyMicros.fetch_add((uint64_t) ((end - start) * 1000000.0), std::memory_order_relaxed);
+		if (stolen)
+			w.steals.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+static void startWorkers(int count)
+{
+	if (!workers.empty())
+		return;
+
+	if (count <= 0)
+		count = std::max((int) std::thread::hardware_concurrency() - 1, 1);
+
+	for (int i = 0; i < count; i++)
+	{
+		std::unique_ptr<Worker> w(new Worker());
+		w->tasks = 0;
+		w->steals = 0;
+		w->busyMicros = 0;
+		workers.push_back(std::move(w));
+	}
+
+	// Started after all exist, as they steal from each other.
+	for (int i = 0; i < count; i++)
+		workers[i]->thread = std::thread(&workerMain, i);
+}
+
+void initialize(int count)
+{
+	if (!workers.empty())
+		return;
+
+	mainThreadID = std::this_thread::get_id();
+	stopping = false;
+	startWorkers(count);
+}
+
+void deinitialize()
+{
+	{
+		std::lock_guard<std::mutex> lock(workerMutex);
+		stopping = true;
+	}
+
+	std::deque<MainTask> discarded;
+
+	{
+		// Wake workers waiting for space in main thread queue.
+		std::lock_guard<std::mutex> lock(mainMutex);
+		discarded.swap(mainQueue);
+		mainNotFull.notify_all();
+	}
+
+	// Before joining, as workers may be waiting for these tasks.
+	for (MainTask &t: discarded)
+	{
+		if (t.cancel)
+			t.cancel();
+	}
+
+	workerCond.notify_all();
+
+	for (std::unique_ptr<Worker> &w: workers)
+		w->thread.join();
+
+	workers.clear();
+	injectQueue.clear();
+	pendingTasks = 0;
+}
+
+int getWorkerCount()
+{
+	return (int) workers.size();
+}
+
+bool isMainThread()
+{
+	return std::this_thread::get_id() == mainThreadID;
+}
+
+void run(std::function<void()> task)
+{
+	push(std::move(task));
+}
+
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &func)
+{
+	grain = std::max(grain, (size_t) 1);
+
+	if (count <= grain || workers.empty())
+	{
+		if (count > 0)
+			func(0, count);
+
+		return;
+	}
+
+	Fence fence;
+	std::exception_ptr exception;
+
+	for (size_t begin = grain; begin < count; begin += grain)
+	{
+		size_t end = std::min(begin + grain, count);
+		fence.run([&func, begin, end]() {func(begin, end);});
+	}
+
+	try
+	{
+		func(0, grain);
+	}
+	catch (...)
+	{
+		exception = std::current_exception();
+	}
+
+	// Tasks reference func, so wait for them even if this range threw.
+	try
+	{
+		fence.wait();
+	}
+	catch (...)
+	{
+		if (!exception)
+			exception = std::current_exception();
+	}
+
+	if (exception)
+		std::rethrow_exception(exception);
+}
+
+void runOnMainThread(std::function<void()> task, std::function<void()> cancel)
+{
+	if (isMainThread())
+	{
+		task();
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mainMutex);
+		mainNotFull.wait(lock, []() {return stopping || mainQueue.size() < mainQueueSize;});
+
+		if (!stopping)
+		{
+			MainTask t = {std::move(task), std::move(cancel)};
+			mainQueue.push_back(std::move(t));
+			mainNotEmpty.notify_one();
+			return;
+		}
+	}
+
+	if (cancel)
+		cancel();
+}
+
+void runOnMainThreadAndWait(std::function<void()> task)
+{
+	if (isMainThread())
+	{
+		task();
+		return;
+	}
+
+	// Shared, as the task may outlive this function when stopping.
+	struct Sync
+	{
+		std::mutex mutex;
+		std::condition_variable cond;
+		bool done;
+		std::exception_ptr exception;
+	};
+
+	std::shared_ptr<Sync> sync = std::make_shared<Sync>();
+	sync->done = false;
+
+	auto finish = [sync](std::exception_ptr exception)
+	{
+		{
+			std::lock_guard<std::mutex> lock(sync->mutex);
+			sync->exception = exception;
+			sync->done = true;
+		}
+
+		sync->cond.notify_all();
+	};
+
+	runOnMainThread([finish, task]()
+	{
+		std::exception_ptr exception;
+
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+
+		finish(exception);
+	},
+	[finish]()
+	{
+		finish(std::make_exception_ptr(love::Exception("Main thread task cancelled.")));
+	});
+
+	std::unique_lock<std::mutex> lock(sync->mutex);
+	sync->cond.wait(lock, [&sync]() {return sync->done;});
+
+	if (sync->exception)
+		std::rethrow_exception(sync->exception);
+}
+
+void setMainThreadBudget(double seconds)
+{
+	mainThreadBudget = seconds;
+}
+
+double getMainThreadBudget()
+{
+	return mainThreadBudget;
+}
+
+void setMainThreadQueueSize(size_t size)
+{
+	std::lock_guard<std::mutex> lock(mainMutex);
+	mainQueueSize = std::max(size, (size_t) 1);
+	mainNotFull.notify_all();
+}
+
+// Runs one queued main thread task, if any.
+static bool runMainThreadTask()
+{
+	std::function<void()> task;
+
+	{
+		std::lock_guard<std::mutex> lock(mainMutex);
+		if (mainQueue.empty())
+			return false;
+
+		task = std::move(mainQueue.front().task);
+		mainQueue.pop_front();
+		mainNotFull.notify_one();
+	}
+
+	task();
+	return true;
+}
+
+size_t processMainThread(double budget)
+{
+	double deadline = timer::getTime() + budget;
+	size_t count = 0;
+
+	while (runMainThreadTask())
+	{
+		count++;
+
+		if (budget >= 0.0 && timer::getTime() >= deadline)
+			break;
+	}
+
+	return count;
+}
+
+void endFrame()
+{
+	double now = timer::getTime();
+	double frameTime = lastFrameTime < 0.0 ? 0.0 : now - lastFrameTime;
+	lastFrameTime = now;
+
+	stats.workers = (int) workers.size();
+	stats.tasks = stats.steals = 0;
+	stats.busyTime = 0.0;
+
+	for (std::unique_ptr<Worker> &w: workers)
+	{
+		stats.tasks += w->tasks.exchange(0, std::memory_order_relaxed);
+		stats.steals += w->steals.exchange(0, std::memory_order_relaxed);
+		stats.busyTime += w->busyMicros.exchange(0, std::memory_order_relaxed) / 1000000.0;
+	}
+
+	if (frameTime > 0.0 && !workers.empty())
+		stats.utilization = std::min(stats.busyTime / (frameTime * workers.size()), 1.0);
+	else
+		stats.utilization = 0.0;
+}
+
+const Stats &getStats()
+{
+	return stats;
+}
+
+Fence::Fence()
+: state(std::make_shared<State>())
+{
+	state->pending = 0;
+}
+
+void Fence::run(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->pending++;
+	}
+
+	std::shared_ptr<State> s = state;
+
+	push([s, task]()
+	{
+		std::exception_ptr exception;
+
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(s->mutex);
+			if (exception && !s->exception)
+				s->exception = exception;
+
+			s->pending--;
+		}
+
+		s->cond.notify_all();
+	});
+}
+
+void Fence::wait()
+{
+	// Tasks of the fence may reference the caller's stack, so helper tasks which
+	// throw can't end the wait early.
+	std::exception_ptr exception;
+	double mainThreadTime = 0.0;
+	bool stalled = false;
+
+	for (;;)
+	{
+		size_t pending;
+
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			pending = state->pending;
+		}
+
+		if (pending == 0)
+			break;
+
+		// Help instead of blocking.
+		try
+		{
+			if (runPendingTask())
+				continue;
+		}
+		catch (...)
+		{
+			if (!exception)
+				exception = std::current_exception();
+
+			continue;
+		}
+
+		// The main thread runs its own lane too, one task at a time and within the main thread
+		// budget. Past the budget, only when the fence made no progress, as its tasks may be
+		// waiting for the main thread.
+		if (isMainThread() && (mainThreadTime < getMainThreadBudget() || stalled))
+		{
+			double start = timer::getTime();
+			bool ran = true;
+
+			try
+			{
+				ran = runMainThreadTask();
+			}
+			catch (...)
+			{
+				if (!exception)
+					exception = std::current_exception();
+			}
+
+			mainThreadTime += timer::getTime() - start;
+
+			if (ran)
+			{
+				stalled = false;
+				continue;
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		stalled = state->cond.wait_for(lock, std::chrono::milliseconds(1)) == std::cv_status::timeout && state->pending == pending;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		if (!exception)
+			exception = state->exception;
+
+		state->exception = nullptr;
+	}
+
+	if (exception)
+		std::rethrow_exception(exception);
+}
+
+bool Fence::isDone() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->pending == 0;
+}
+
+Fence &getFrameFence()
+{
+	static Fence fence;
+	return fence;
+}
+
+TaskGraph::TaskID TaskGraph::add(std::function<void()> task, const std::vector<TaskID> &dependencies)
+{
+	TaskID id = nodes.size();
+	std::unique_ptr<Node> node(new Node());
+	node->task = std::move(task);
+	node->dependencies = (int) dependencies.size();
+	node->remaining = 0;
+
+	for (TaskID d: dependencies)
+	{
+		if (d >= id)
+			throw love::Exception("Invalid task dependency %d.", (int) d);
+
+		nodes[d]->dependents.push_back(id);
+	}
+
+	nodes.push_back(std::move(node));
+	return id;
+}
+
+void TaskGraph::start(TaskID id)
+{
+	fence.run([this, id]()
+	{
+		Node &node = *nodes[id];
+		node.task();
+
+		for (TaskID d: node.dependents)
+		{
+			if (--nodes[d]->remaining == 0)
+				start(d);
+		}
+	});
+}
+
+void TaskGraph::run()
+{
+	if (!fence.isDone())
+		throw love::Exception("Task graph is already running.");
+
+	for (std::unique_ptr<Node> &node: nodes)
+		node->remaining = node->dependencies;
+
+	for (TaskID i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i]->dependencies == 0)
+			start(i);
+	}
+}
+
+void TaskGraph::wait()
+{
+	fence.wait();
+}
+
+void TaskGraph::clear()
+{
+	if (!fence.isDone())
+		throw love::Exception("Task graph is running.");
+
+	nodes.clear();
+}
+
+FutureBase::FutureBase()
+: state(std::make_shared<State>())
+{
+	state->ready = false;
+}
+
+bool FutureBase::isReady() const
+{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->ready;
+}
+
+void FutureBase::wait() const
+{
+	if (isMainThread())
+	{
+		// Result may depend on main thread task, so keep running them.
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(state->mutex);
+				if (state->ready)
+					return;
+			}
+
+			if (processMainThread(-1.0) == 0)
+			{
+				std::unique_lock<std::mutex> lock(mainMutex);
+				mainNotEmpty.wait_for(lock, std::chrono::milliseconds(1));
+			}
+		}
+	}
+	else
+	{
+		// The result may be queued behind the calling worker, so run tasks meanwhile, like
+		// Fence::wait.
+		std::exception_ptr exception;
+
+		for (;;)
+		{
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				if (state->ready)
+					break;
+			}
+
+			try
+			{
+				if (runPendingTask())
+					continue;
+			}
+			catch (...)
+			{
+				if (!exception)
+					exception = std::current_exception();
+
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->cond.wait_for(lock, std::chrono::milliseconds(1), [this]() {return state->ready;});
+		}
+
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+}
+
+void FutureBase::setValue(love::Object *object) const
+{
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->value.set(object);
+		state->ready = true;
+	}
+
+	state->cond.notify_all();
+}
+
+void FutureBase::setException(std::exception_ptr exception) const
+{
+	{
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->exception = exception;
+		state->ready = true;
+	}
+
+	state->cond.notify_all();
+}
+
+love::Object *FutureBase::getObject() const
+{
+	wait();
+
+	std::lock_guard<std::mutex> lock(state->mutex);
+	if (state->exception)
+		std::rethrow_exception(state->exception);
+
+	return state->value.get();
+}
+
+} // job
+} // lovewrap
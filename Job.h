@@ -0,0 +1,249 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_JOB_H
+#define LOVEWRAP_JOB_H
+
+// STL
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// LOVE
+#include "common/Object.h"
+
+namespace lovewrap
+{
+namespace job
+{
+
+/**
+ * Starts worker threads. Called by runGame, from the main thread.
+ * @param workers Amount of worker threads. 0 means amount of CPU cores minus one.
+ */
+void initialize(int workers = 0);
+/**
+ * Stops worker threads after their current task. Tasks which haven't been started are discarded,
+ * and main thread tasks are cancelled. Tasks started afterwards run immediately in the calling
+ * thread.
+ */
+void deinitialize();
+int getWorkerCount();
+bool isMainThread();
+
+/**
+ * Runs task in worker thread. Tasks started from a worker go to its own queue, which other
+ * workers steal from when theirs are empty.
+ * @param task Function to run.
+ */
+void run(std::function<void()> task);
+/**
+ * Calls func(begin, end) for ranges of [0, count), in worker threads and the calling thread,
+ * and waits for them. Can be called from worker threads too.
+ * @param count Amount of items.
+ * @param grain Items per range. The last range may be smaller.
+ * @param func Function to run for each range. Exception thrown by it is rethrown after
+ *             all ranges have finished.
+ */
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &func);
+/**
+ * Queues task to be run in the main thread by the game loop, e.g. for creating graphics objects.
+ * The queue is bounded, so when it's full, worker threads wait until there's space. When
+ * called from the main thread, the task is run immediately.
+ * @param task Function to run.
+ * @param cancel Function called instead of the task if it's discarded by deinitialize, e.g. to
+ *               fail a Future waiting for the task.
+ */
+void runOnMainThread(std::function<void()> task, std::function<void()> cancel = std::function<void()>());
+/**
+ * Runs task in the main thread and waits for it to finish. Exception thrown by the task is
+ * rethrown. When called from the main thread, the task is run immediately.
+ * @param task Function to run.
+ */
+void runOnMainThreadAndWait(std::function<void()> task);
+/**
+ * Sets time spent running main thread tasks each frame. At least one task is run each frame.
+ * @param seconds Time budget, in seconds.
+ */
+void setMainThreadBudget(double seconds);
+void setMainThreadQueueSize(size_t size);
+/**
+ * Runs queued main thread tasks. Called by the game loop.
+ * @param budget Time limit, in seconds. Negative means run all of them.
+ * @return Amount of tasks run.
+ */
+size_t processMainThread(double budget);
+double getMainThreadBudget();
+
+struct Stats
+{
+	int workers;
+	uint64_t tasks;     // Tasks run by workers last frame
+	uint64_t steals;    // Tasks taken from queue of another worker last frame
+	double busyTime;    // Time workers spent running tasks last frame, in seconds
+	double utilization; // busyTime / (workers * frame time), 0 to 1
+};
+
+/**
+ * Collects worker statistics of the frame. Called by the game loop at the start of frame.
+ */
+void endFrame();
+const Stats &getStats();
+
+// Tracks a group of tasks, so they can be waited for.
+class Fence
+{
+public:
+	Fence();
+
+	/**
+	 * Runs task in worker thread as part of this fence.
+	 * @param task Function to run.
+	 */
+	void run(std::function<void()> task);
+	/**
+	 * Waits until all tasks of the fence have finished, running other tasks meanwhile. In the
+	 * main thread, main thread tasks are run too, within getMainThreadBudget unless the fence
+	 * stops making progress. The first exception thrown by the tasks, or by the tasks run
+	 * meanwhile, is rethrown after all tasks of the fence have finished.
+	 */
+	void wait();
+	bool isDone() const;
+
+private:
+	struct State
+	{
+		std::mutex mutex;
+		std::condition_variable cond;
+		size_t pending;
+		std::exception_ptr exception;
+	};
+
+	std::shared_ptr<State> state;
+};
+
+/**
+ * Gets the fence of the current frame. The game loop waits for it after Scene::update and
+ * before Scene::draw, so tasks run with it can work on update results until drawing.
+ */
+Fence &getFrameFence();
+
+// Tasks with dependencies. Tasks start once all their dependencies have finished.
+class TaskGraph
+{
+public:
+	typedef size_t TaskID;
+
+	/**
+	 * Adds task.
+	 * @param task Function to run.
+	 * @param dependencies Tasks which must finish first. They must be added before this one.
+	 * @return ID of the task.
+	 */
+	TaskID add(std::function<void()> task, const std::vector<TaskID> &dependencies = std::vector<TaskID>());
+	/**
+	 * Starts tasks without dependencies. The graph can be run again after wait().
+	 */
+	void run();
+	/**
+	 * Waits until all tasks have finished. If a task throws, its dependents don't run and the
+	 * exception is rethrown here.
+	 */
+	void wait();
+	void clear();
+
+private:
+	struct Node
+	{
+		std::function<void()> task;
+		std::vector<TaskID> dependents;
+		int dependencies;
+		std::atomic<int> remaining;
+	};
+
+	void start(TaskID id);
+
+	std::vector<std::unique_ptr<Node>> nodes;
+	Fence fence;
+};
+
+// Shared part of Future. Holds result of asynchronous function.
+class FutureBase
+{
+public:
+	FutureBase();
+
+	bool isReady() const;
+	/**
+	 * Waits until result is available. When called from the main thread, main thread tasks
+	 * are processed while waiting so it can't deadlock on them. Worker threads run queued
+	 * tasks meanwhile instead, and exception thrown by those is rethrown once the result is
+	 * available.
+	 */
+	void wait() const;
+
+	// Used by the asynchronous function to set its result. The object is retained.
+	void setValue(love::Object *object) const;
+	void setException(std::exception_ptr exception) const;
+
+protected:
+	// Waits, rethrows exception if any, and returns the value.
+	love::Object *getObject() const;
+
+private:
+	struct State
+	{
+		std::mutex mutex;
+		std::condition_variable cond;
+		bool ready;
+		love::StrongRef<love::Object> value;
+		std::exception_ptr exception;
+	};
+
+	std::shared_ptr<State> state;
+};
+
+template<typename T>
+class Future: public FutureBase
+{
+public:
+	/**
+	 * Waits and returns the object. Like the other new* functions, the object is retained
+	 * for the caller, so release it when it's no longer used.
+	 * @return The object. Throws the exception thrown while creating it instead, if any.
+	 */
+	T *get() const
+	{
+		T *object = static_cast<T*>(getObject());
+		object->retain();
+		return object;
+	}
+};
+
+} // job
+} // lovewrap
+
+#endif
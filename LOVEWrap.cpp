@@ -22,11 +22,17 @@
 // its Lua counterpart, like love.graphics.newShader
 
 // STL
+#include <cstdio>
+#include <cstring>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 
-// love
-#include "modules/graphics/wrap_Shader.h"
+// Lua
+extern "C" {
+#include "lua.h"
+#include "lauxlib.h"
+}
 
 // lovewrap
 #include "LOVEWrap.h"
@@ -34,13 +40,8 @@
 static lua_State *globalL = nullptr;
 static std::recursive_mutex luaLock;
 
-// Assume error message is at -1
-inline std::string getLuaError(lua_State *L)
-{
-	size_t strSize;
-	const char *str = lua_tolstring(globalL, -1, &strSize);
-	return std::string(str, strSize);
-}
+// Incremented by initialize, so LuaFunction refs of previous state are resolved again.
+static unsigned int luaGeneration = 0;
 
 // Class used to reset Lua stack
 class lua_stack_balance
@@ -64,6 +65,131 @@ private:
 	lua_State *L;
 };
 
+// Lua function looked up once by its path from globals (like "love.graphics.newShader")
+// and kept in the registry. Must be used with luaLock held.
+class LuaFunction
+{
+public:
+	LuaFunction(const char *path): path(path), ref(LUA_NOREF), generation(0) {}
+	LuaFunction(const LuaFunction&) = delete;
+	LuaFunction& operator=(const LuaFunction&) = delete;
+
+	void push(lua_State *L)
+	{
+		if (ref == LUA_NOREF || generation != luaGeneration)
+			resolve(L);
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+	}
+
+private:
+	void resolve(lua_State *L)
+	{
+		char name[128];
+		const char *start = path;
+		bool first = true;
+
+		for (;;)
+		{
+			const char *end = strchr(start, '.');
+			size_t len = end ? (size_t) (end - start) : strlen(start);
+
+			if (len >= sizeof(name))
+				throw love::Exception("Lua function path '%s' is too long.", path);
+
+			memcpy(name, start, len);
+			name[len] = 0;
+
+			if (first)
+				lua_getglobal(L, name);
+			else
+			{
+				lua_getfield(L, -1, name);
+				lua_remove(L, -2);
+			}
+
+			if (end == nullptr)
+				break;
+
+			if (lua_type(L, -1) != LUA_TTABLE)
+			{
+				lua_pop(L, 1);
+				throw love::Exception("Lua function '%s' not found.", path);
+			}
+
+			start = end + 1;
+			first = false;
+		}
+
+		if (lua_type(L, -1) != LUA_TFUNCTION)
+		{
+			lua_pop(L, 1);
+			throw love::Exception("Lua function '%s' not found.", path);
+		}
+
+		// The registry is per state, the old ref went with the old state.
+		ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		generation = luaGeneration;
+	}
+
+	const char *path;
+	int ref;
+	unsigned int generation;
+};
+
+// Argument pushers for callLua
+static inline void pushLua(lua_State *L, bool value) { lua_pushboolean(L, value); }
+static inline void pushLua(lua_State *L, int value) { lua_pushinteger(L, (lua_Integer) value); }
+static inline void pushLua(lua_State *L, float value) { lua_pushnumber(L, value); }
+static inline void pushLua(lua_State *L, double value) { lua_pushnumber(L, value); }
+static inline void pushLua(lua_State *L, const char *value) { lua_pushstring(L, value); }
+static inline void pushLua(lua_State *L, const std::string &value) { lua_pushlstring(L, value.c_str(), value.length()); }
+static inline void pushLua(lua_State *L, std::nullptr_t) { lua_pushnil(L); }
+
+// nullptr is nil
+static inline void pushLua(lua_State *L, const std::string *value)
+{
+	if (value)
+		pushLua(L, *value);
+	else
+		lua_pushnil(L);
+}
+
+// Other pointers would silently convert to bool.
+template<typename T>
+static void pushLua(lua_State *L, const T *value) = delete;
+
+static inline void pushLuaArgs(lua_State *) {}
+
+template<typename T, typename... Ts>
+static inline void pushLuaArgs(lua_State *L, const T &value, const Ts&... rest)
+{
+	pushLua(L, value);
+	pushLuaArgs(L, rest...);
+}
+
+/**
+ * Calls Lua function with arguments, leaving its results on the stack. Must be called with
+ * luaLock held. Lua error is thrown as love::Exception.
+ * @param func The function.
+ * @param results Amount of results.
+ */
+template<typename... Ts>
+static void callLua(LuaFunction &func, int results, const Ts&... args)
+{
+	func.push(globalL);
+	pushLuaArgs(globalL, args...);
+
+	if (lua_pcall(globalL, (int) sizeof...(Ts), results, 0))
+	{
+		const char *error = lua_tostring(globalL, -1);
+		// Exception copies the message, so the Lua string can go.
+		love::Exception e("%s", error ? error : "(error object is not a string)");
+		lua_pop(globalL, 1);
+		throw e;
+	}
+}
+
 namespace lovewrap
 {
 
@@ -71,52 +197,243 @@ void initialize(lua_State *L)
 {
 	std::lock_guard<std::recursive_mutex> dummyLock(luaLock);
 	globalL = L;
+	luaGeneration++;
 }
 
 namespace graphics
 {
 
-Shader *newShader(const std::string &data)
+// Shaders are created natively from preprocessed GLSL. Preprocessing is done by
+// love.graphics._shaderCodeToGLSL once per code and backend, then the result is
+// kept in memory and in the save directory, so later runs don't need Lua.
+struct ShaderSource
+{
+	std::string vertex;
+	std::string pixel;
+};
+
+static const char *SHADER_CACHE_DIR = "lovewrap/shader";
+static const char SHADER_CACHE_MAGIC[8] = {'L', 'W', 'S', 'H', 'D', 'R', '0', '1'};
+
+static std::mutex shaderCacheMutex;
+static std::unordered_map<uint64_t, ShaderSource> shaderCache;
+static std::string shaderBackend;
+static bool shaderBackendGLES = false;
+static bool shaderDiskCache = true;
+
+static uint64_t hashShaderString(const std::string &str, uint64_t h)
+{
+	for (char c: str)
+		h = (h ^ (uint8_t) c) * 1099511628211ULL;
+
+	// Separator, so ("ab", "c") and ("a", "bc") differ.
+	return (h ^ 0xFFULL) * 1099511628211ULL;
+}
+
+// Must be called from the main thread.
+static void initializeShaderBackend()
+{
+	std::lock_guard<std::mutex> lock(shaderCacheMutex);
+	if (!shaderBackend.empty())
+		return;
+
+	Graphics *g = getInstance();
+	Graphics::RendererInfo info = g->getRendererInfo();
+
+	shaderBackendGLES = info.name == "OpenGL ES";
+	shaderBackend = info.name + "|" + info.version + "|" + info.vendor + "|" + info.device;
+	shaderBackend += g->getCapabilities().features[Graphics::FEATURE_GLSL3] ? "|glsl3" : "|glsl1";
+	shaderBackend += g->isGammaCorrect() ? "|gamma" : "|linear";
+}
+
+static bool isShaderFile(const std::string &path)
+{
+	return filesystem::getInfo(path, love::filesystem::Filesystem::FILETYPE_FILE, nullptr);
+}
+
+// Code which is a filename is replaced with the file contents, like love.graphics.newShader
+static std::string resolveShaderCode(const std::string &code)
+{
+	if (code.empty() || code.find('\n') != std::string::npos)
+		return code;
+
+	if (!isShaderFile(code))
+		return code;
+
+	love::StrongRef<love::filesystem::FileData> fd(filesystem::newFileData(code), love::Acquire::NORETAIN);
+	return std::string((const char *) fd->getData(), fd->getSize());
+}
+
+static std::string getShaderCachePath(uint64_t key)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%s/%016llx.glsl", SHADER_CACHE_DIR, (unsigned long long) key);
+	return buf;
+}
+
+static bool readShaderCache(uint64_t key, ShaderSource &source)
+{
+	std::string path = getShaderCachePath(key);
+	uint32_t lengths[2];
+
+	if (!isShaderFile(path))
+		return false;
+
+	try
+	{
+		love::StrongRef<love::filesystem::FileData> fd(filesystem::newFileData(path), love::Acquire::NORETAIN);
+		const char *data = (const char *) fd->getData();
+		size_t size = fd->getSize();
+		size_t headerSize = sizeof(SHADER_CACHE_MAGIC) + sizeof(lengths);
+
+		if (size < headerSize || memcmp(data, SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC)) != 0)
+			return false;
+
+		memcpy(lengths, data + sizeof(SHADER_CACHE_MAGIC), sizeof(lengths));
+		if (size != headerSize + (size_t) lengths[0] + (size_t) lengths[1])
+			return false;
+
+		source.vertex.assign(data + headerSize, lengths[0]);
+		source.pixel.assign(data + headerSize + lengths[0], lengths[1]);
+		return true;
+	}
+	catch (love::Exception &)
+	{
+		return false;
+	}
+}
+
+static void writeShaderCache(uint64_t key, const ShaderSource &source)
+{
+	uint32_t lengths[2] = {(uint32_t) source.vertex.length(), (uint32_t) source.pixel.length()};
+	std::string data(SHADER_CACHE_MAGIC, sizeof(SHADER_CACHE_MAGIC));
+
+	data.append((const char *) lengths, sizeof(lengths));
+	data += source.vertex;
+	data += source.pixel;
+
+	// Cache is optional, e.g. there's no save directory without identity.
+	try
+	{
+		std::string path = getShaderCachePath(key);
+		filesystem::createDirectory(SHADER_CACHE_DIR);
+		filesystem::getInstance()->write(path.c_str(), data.c_str(), (int64_t) data.length());
+		filesystem::invalidateIndex(path);
+	}
+	catch (love::Exception &) {}
+}
+
+static LuaFunction shaderCodeToGLSL("love.graphics._shaderCodeToGLSL");
+
+// Must be called from the main thread.
+static ShaderSource preprocessShader(const std::string &vertex, const std::string *pixel)
 {
 	std::lock_guard<std::recursive_mutex> dummyLock(luaLock);
 	lua_stack_balance dummyLS(globalL);
+	ShaderSource source;
 
-	lua_getglobal(globalL, "love");
-	lua_getfield(globalL, -1, "graphics");
-	lua_getfield(globalL, -1, "newShader");
-	lua_pushlstring(globalL, data.c_str(), data.length());
+	callLua(shaderCodeToGLSL, 2, shaderBackendGLES, vertex, pixel);
 
-	// Call love.graphics.newShader(data)
-	if (lua_pcall(globalL, 1, 1, 0))
-		throw love::Exception("%s", getLuaError(globalL).c_str());
+	if (lua_isstring(globalL, -2))
+	{
+		size_t len;
+		const char *str = lua_tolstring(globalL, -2, &len);
+		source.vertex.assign(str, len);
+	}
+
+	if (lua_isstring(globalL, -1))
+	{
+		size_t len;
+		const char *str = lua_tolstring(globalL, -1, &len);
+		source.pixel.assign(str, len);
+	}
+
+	if (source.vertex.empty() && source.pixel.empty())
+		throw love::Exception("Could not parse shader code.");
+
+	return source;
+}
+
+static Shader *createShader(const std::string &vertexCode, const std::string *pixelCode)
+{
+	std::string vertex = resolveShaderCode(vertexCode);
+	std::string pixel = pixelCode ? resolveShaderCode(*pixelCode) : std::string();
+	ShaderSource source;
+	bool found = false;
+	uint64_t key;
+
+	{
+		std::unique_lock<std::mutex> lock(shaderCacheMutex);
+		if (shaderBackend.empty())
+		{
+			lock.unlock();
+			job::runOnMainThreadAndWait(&initializeShaderBackend);
+			lock.lock();
+		}
+
+		key = hashShaderString(shaderBackend, 14695981039346656037ULL);
+		key = hashShaderString(vertex, key);
+		key = pixelCode ? hashShaderString(pixel, key) : key;
+
+		auto iter = shaderCache.find(key);
+		if (iter != shaderCache.end())
+		{
+			source = iter->second;
+			found = true;
+		}
+	}
+
+	if (!found)
+	{
+		if (shaderDiskCache && readShaderCache(key, source))
+			found = true;
+		else
+		{
+			job::runOnMainThreadAndWait([&]() {
+				source = preprocessShader(vertex, pixelCode ? &pixel : nullptr);
+			});
+
+			if (shaderDiskCache)
+				writeShaderCache(key, source);
+		}
+
+		std::lock_guard<std::mutex> lock(shaderCacheMutex);
+		shaderCache[key] = source;
+	}
+
+	Shader *shader = nullptr;
+	job::runOnMainThreadAndWait([&]() {
+		shader = getInstance()->newShader(source.vertex, source.pixel);
+	});
 
-	// Have shader in -1
-	Shader *shader = luax_checkshader(globalL, -1);
-	// Retain so when Lua GC it we still have the object
-	shader->retain();
 	return shader;
 }
 
+Shader *newShader(const std::string &data)
+{
+	return createShader(data, nullptr);
+}
+
 Shader *newShader(const std::string &vertex, const std::string &pixel)
 {
-	std::lock_guard<std::recursive_mutex> dummyLock(luaLock);
-	lua_stack_balance dummyLS(globalL);
+	return createShader(vertex, &pixel);
+}
 
-	lua_getglobal(globalL, "love");
-	lua_getfield(globalL, -1, "graphics");
-	lua_getfield(globalL, -1, "newShader");
-	lua_pushlstring(globalL, vertex.c_str(), vertex.length());
-	lua_pushlstring(globalL, pixel.c_str(), pixel.length());
+void setShaderDiskCache(bool enable)
+{
+	std::lock_guard<std::mutex> lock(shaderCacheMutex);
+	shaderDiskCache = enable;
+}
 
-	// Call love.graphics.newShader(vertex, pixel)
-	if (lua_pcall(globalL, 2, 1, 0))
-		throw love::Exception("%s", getLuaError(globalL).c_str());
+bool isShaderDiskCache()
+{
+	return shaderDiskCache;
+}
 
-	// Have shader in -1
-	Shader *shader = luax_checkshader(globalL, -1);
-	// Retain so when Lua GC it we still have the object
-	shader->retain();
-	return shader;
+void clearShaderCache()
+{
+	std::lock_guard<std::mutex> lock(shaderCacheMutex);
+	shaderCache.clear();
 }
 
 } // graphics
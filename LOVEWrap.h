@@ -23,7 +23,9 @@
 
 // STL
 #include <functional>
+#include <initializer_list>
 #include <string>
+#include <vector>
 
 // LOVE
 #include "common/Module.h"
@@ -62,11 +64,34 @@
 /* love.window */
 #include "modules/window/Window.h"
 
+// lovewrap
+#include "Job.h"
+
 namespace lovewrap
 {
 
 void initialize(lua_State *L);
 
+// Non-owning view of contiguous values. Can be made from pointer and size,
+// array, std::vector or initializer list (the last one is only valid until
+// the end of the full expression, which is fine for function arguments).
+template<typename T>
+struct Span
+{
+	const T *data;
+	size_t size;
+
+	Span(): data(nullptr), size(0) {}
+	Span(const T *data, size_t size): data(data), size(size) {}
+	Span(std::initializer_list<T> list): data(std::begin(list)), size(list.size()) {}
+	Span(const std::vector<T> &vec): data(vec.data()), size(vec.size()) {}
+	template<size_t N> Span(const T (&arr)[N]): data(arr), size(N) {}
+
+	const T *begin() const { return data; }
+	const T *end() const { return data + size; }
+	const T &operator[](size_t i) const { return data[i]; }
+};
+
 namespace audio
 {
 	using namespace love::audio;
@@ -307,7 +332,8 @@ namespace filesystem
 	 * The table is not sorted in any way; the order is undefined.
 	 *
 	 * If the path passed to the function exists in the game and the save directory, it
-	 * will list the files and directories from both places.
+	 * will list the files and directories from both places. Listings are cached, see
+	 * invalidateIndex.
 	 * @param dir The directory.
 	 * @return A sequence with the names of all files and subdirectories as strings.
 	 */
@@ -330,7 +356,8 @@ namespace filesystem
 	 */
 	std::string getIdentity();
 	/**
-	 * Gets information about the specified file or directory.
+	 * Gets information about the specified file or directory. Information is cached, see
+	 * invalidateIndex.
 	 * @param path The file or directory path to check.
 	 * @param filtertype If supplied, this parameter causes getInfo to only return the info
 	 *                   table if the item at the given path matches the specified file type.
@@ -353,10 +380,51 @@ namespace filesystem
 	 * @return The platform-specific full path of the directory containing the filepath, or empty string on failure.
 	 */
 	std::string getRealDirectory(const std::string &filepath);
+	/**
+	 * Finds files and directories matching pattern. "*" and "?" match within a path component,
+	 * and a "**" component matches any amount of directories, so PNG files anywhere inside
+	 * sprites directory are found with "sprites", "**" and "*.png" components joined by slash.
+	 * @param pattern The pattern.
+	 * @return Matching paths, sorted.
+	 */
+	std::vector<std::string> glob(const std::string &pattern);
+	void glob(const std::string &pattern, std::function<void(const std::string&)> callback);
+	/**
+	 * Forgets cached directory listing and info of path and its parent directories. Writes
+	 * through lovewrap do this automatically; call it after writing with love::filesystem
+	 * directly.
+	 * @param path The changed path. Empty string forgets everything.
+	 */
+	void invalidateIndex(const std::string &path = std::string());
 	std::string getSaveDirectory();
+	/**
+	 * Reads file into FileData. Files at least as big as getMapThreshold are memory mapped
+	 * instead, when they're directly on disk.
+	 * @param path The file path.
+	 * @return The FileData.
+	 */
 	love::filesystem::FileData *newFileData(const std::string &path);
+	/**
+	 * Creates FileData which is memory mapped, regardless of the file size. Files which aren't
+	 * directly on disk, e.g. inside .love archive, are read like newFileData.
+	 * @param path The file path.
+	 * @return The FileData. Writes to its data don't change the file.
+	 */
+	love::filesystem::FileData *newMappedFileData(const std::string &path);
+	/**
+	 * Sets minimum file size for newFileData to memory map the file.
+	 * @param bytes Size in bytes. 0 disables memory mapping.
+	 */
+	void setMapThreshold(size_t bytes);
+	size_t getMapThreshold();
 	love::filesystem::FileData *newFileData(const void *contents, size_t len, const std::string &filename);
 	love::filesystem::FileData *newFileData(const love::Data *data, const std::string &filename);
+	/**
+	 * Reads file in worker thread.
+	 * @param path The file path.
+	 * @return Future of the FileData.
+	 */
+	job::Future<love::filesystem::FileData> newFileDataAsync(const std::string &path);
 	/**
 	 * Sets the source of the game, where the code is present. This is internal function!
 	 * @param source Absolute path to the game's source folder.
@@ -410,12 +478,49 @@ namespace graphics
 	void draw(Texture *texture, Quad *quad, float x = 0.0f, float y = 0.0f, float r = 0.0f, float sx = 1.0f, float sy = 1.0f, float ox = 0.0f, float oy = 0.0f, float kx = 0.0f, float ky = 0.0f);
 	void draw(Drawable *drawable, love::math::Transform *transform);
 	void draw(Texture *texture, Quad *quad, love::math::Transform *transform);
+	// Sprites for drawMany, as structure of arrays. Only x and y are required, empty spans
+	// use the default value. Other spans must be at least as long as x.
+	struct SpriteArrays
+	{
+		Span<float> x;
+		Span<float> y;
+		Span<float> rotation;        // Default 0
+		Span<float> scaleX;          // Default 1
+		Span<float> scaleY;          // Default scaleX
+		Span<uint16_t> quad;         // Index to quads, default 0
+		Span<love::Color32> color;   // Multiplied by the current color, default white
+		float ox, oy;                // Origin of all sprites
+
+		SpriteArrays(): ox(0.0f), oy(0.0f) {}
+	};
+
+	/**
+	 * Draws many sprites of one texture in as few draw calls as possible. Vertices are
+	 * generated in bulk, straight into LOVE's streaming vertex buffer.
+	 * @param texture The texture.
+	 * @param quads Quads of the texture, indexed by sprites.quad. Empty means whole texture.
+	 * @param sprites The sprites. y must have as many elements as x, and the other arrays as
+	 *                many or none, otherwise love::Exception is thrown.
+	 */
+	void drawMany(Texture *texture, Span<Quad*> quads, const SpriteArrays &sprites);
 	void points(const love::Vector2 *pos, const love::Colorf *cols, size_t amount);
 	void present();
+	/**
+	 * Draws text with the current font. The laid out text is kept in a Text object, keyed by
+	 * font, string and colors, so printing the same text again doesn't lay it out again.
+	 * See setTextCacheFrames.
+	 */
 	void print(const std::string &text, float x = 0.0f, float y = 0.0f, float r = 0.0f, float sx = 1.0f, float sy = 1.0f, float ox = 0.0f, float oy = 0.0f, float kx = 0.0f, float ky = 0.0f);
-	void print(std::vector<Font::ColoredString> coloredText, float x = 0.0f, float y = 0.0f, float r = 0.0f, float sx = 1.0f, float sy = 1.0f, float ox = 0.0f, float oy = 0.0f, float kx = 0.0f, float ky = 0.0f);
-	void print(const std::string &text, love::math::Transform transform);
-	void print(std::vector<Font::ColoredString> coloredText, love::math::Transform transform);
+	void print(const std::vector<Font::ColoredString> &coloredText, float x = 0.0f, float y = 0.0f, float r = 0.0f, float sx = 1.0f, float sy = 1.0f, float ox = 0.0f, float oy = 0.0f, float kx = 0.0f, float ky = 0.0f);
+	void print(const std::string &text, const love::math::Transform &transform);
+	void print(const std::vector<Font::ColoredString> &coloredText, const love::math::Transform &transform);
+	/**
+	 * Sets how many frames cached text is kept after it was last printed. Text objects of
+	 * evicted text are reused for new text of the same font.
+	 * @param frames Amount of frames. 0 disables the cache.
+	 */
+	void setTextCacheFrames(int frames);
+	int getTextCacheFrames();
 	void rectangle(Graphics::DrawMode mode, float x, float y, float w, float h);
 	void rectangle(Graphics::DrawMode mode, float x, float y, float w, float h, float rx, float ry);
 	void rectangle(Graphics::DrawMode mode, float x, float y, float w, float h, float rx, float ry, int segments);
@@ -450,10 +555,35 @@ namespace graphics
 	Image *newImage(love::filesystem::FileData *filedata, const Image::Settings *settings = nullptr);
 	Image *newImage(love::image::ImageData *imagedata, const Image::Settings *settings = nullptr);
 	Image *newImage(love::image::CompressedImageData *compressedImageData, const Image::Settings *settings = nullptr);
+	/**
+	 * Creates a new Image from a filepath asynchronously. File reading and decoding are done in
+	 * worker thread, then the Image is created in the main thread by the game loop, limited by
+	 * job::setMainThreadBudget each frame.
+	 * @param filename The filepath to the image file.
+	 * @param settings Image settings. The struct is copied.
+	 * @return Future of the Image.
+	 */
+	job::Future<Image> newImageAsync(const std::string &filename, const Image::Settings *settings = nullptr);
 	Mesh *newMesh(const std::vector<Mesh::AttribFormat> &vertexformat, int vertexcount, PrimitiveType drawmode, vertex::Usage usage);
 	Mesh *newMesh(const std::vector<Mesh::AttribFormat> &vertexformat, const void *data, size_t datasize, PrimitiveType drawmode, vertex::Usage usage);
+	/**
+	 * Creates a new Shader. Code can be a filepath. The code is preprocessed to GLSL by LOVE
+	 * once per code and renderer, and the result is cached in memory and in the save directory,
+	 * so creating the same Shader again doesn't go through Lua. Can be called from worker
+	 * threads, in which case the Shader is created in the main thread by the game loop.
+	 * @param content Vertex and/or pixel shader code, or filepath to it.
+	 * @return The Shader.
+	 */
 	Shader *newShader(const std::string &content);
 	Shader *newShader(const std::string &vertex, const std::string &pixel);
+	/**
+	 * Sets whether preprocessed shader code is stored in the save directory. Enabled by default.
+	 * @param enable Enable disk cache?
+	 */
+	void setShaderDiskCache(bool enable);
+	bool isShaderDiskCache();
+	/* Clears preprocessed shader code kept in memory. Files in the save directory are kept. */
+	void clearShaderCache();
 	SpriteBatch *newSpriteBatch(Texture *tex, int reservedPoints = 1000, vertex::Usage usage = vertex::USAGE_DYNAMIC);
 	
 	love::Colorf getBackgroundColor();
@@ -477,8 +607,87 @@ namespace graphics
 	void setShader(Shader *shader = nullptr);
 	void setWireframe(bool enable);
 
+	struct BatchStats
+	{
+		size_t batched;   // Draws added to auto-batch
+		size_t submitted; // Auto-batch draw calls
+		size_t unbatched; // Draws which weren't batched
+	};
+
+	/**
+	 * Enables or disables auto-batching (disabled by default). When enabled, consecutive
+	 * textured draw calls with the same texture, shader, blend mode and color mask are
+	 * collected into one SpriteBatch, with current transform and color (8 bits per channel)
+	 * baked in. The batch is drawn by other lovewrap draw functions, state changes through
+	 * lovewrap, and present.
+	 * @param enable Whether to batch draws.
+	 */
+	void setAutoBatch(bool enable);
+	bool isAutoBatch();
+	/**
+	 * Draws the pending auto-batch. Only needed before drawing or changing state through
+	 * Graphics directly.
+	 */
+	void flushBatch();
+	BatchStats getBatchStats();
+	void resetBatchStats();
+
 	namespace shader
 	{
+		// Uniform resolved by getUniform. Sending through it doesn't look up the name.
+		// Only valid as long as the Shader is alive.
+		struct Uniform
+		{
+			Shader *shader;
+			const Shader::UniformInfo *info;
+		};
+
+		/**
+		 * Looks up shader uniform and checks its type.
+		 * @param shader The Shader.
+		 * @param name Uniform name.
+		 * @param type Expected uniform type.
+		 * @return Uniform handle to be used with send functions.
+		 */
+		Uniform getUniform(Shader *shader, const std::string &name, Shader::UniformType type);
+
+		void sendBools(const Uniform &uniform, Span<bool> values);
+		void sendInts(const Uniform &uniform, Span<int> values);
+		void sendUInts(const Uniform &uniform, Span<unsigned int> values);
+		void sendFloats(const Uniform &uniform, Span<float> values);
+		/**
+		 * Sends matrices (column-major) to matrix uniform.
+		 * @param uniform Uniform handle.
+		 * @param values Matrix elements. Size must be multiple of the uniform matrix size.
+		 */
+		void sendMatrices(const Uniform &uniform, Span<float> values);
+		void sendTextures(const Uniform &uniform, Span<Texture*> values);
+
+		struct StagingStats
+		{
+			size_t skipped;   // Sends which had the same value as the current one
+			size_t coalesced; // Sends overwritten by another send before being uploaded
+			size_t committed; // Uniform uploads
+		};
+
+		/**
+		 * Enables or disables uniform staging (enabled by default). When enabled, send
+		 * functions only store the value and the changed uniforms are uploaded once, right
+		 * before the shader is used by lovewrap draw functions. Textures are always sent
+		 * immediately.
+		 * @param enable Whether to stage uniform values.
+		 */
+		void setStaging(bool enable);
+		bool isStaging();
+		/**
+		 * Uploads staged uniform values of the shader. This is done automatically by lovewrap
+		 * draw functions, so it's only needed when drawing through Graphics directly.
+		 * @param shader Shader to upload. nullptr means the active shader.
+		 */
+		void commit(Shader *shader = nullptr);
+		StagingStats getStagingStats();
+		void resetStagingStats();
+
 		void sendBools(Shader *shader, const std::string &name, std::initializer_list<bool> values);
 		void sendInts(Shader *shader, const std::string &name, std::initializer_list<int> values);
 		void sendUInts(Shader *shader, const std::string &name, std::initializer_list<unsigned int> values);
@@ -516,8 +725,50 @@ namespace image
 		return love::Module::getInstance<Image>(love::Module::M_IMAGE);
 	}
 
+	// Image file formats, detected from their header.
+	enum FileFormat
+	{
+		FORMAT_UNKNOWN, // e.g. TGA, which has no magic bytes
+		// Decoded to ImageData
+		FORMAT_PNG,
+		FORMAT_JPEG,
+		FORMAT_BMP,
+		FORMAT_GIF,
+		FORMAT_PSD,
+		FORMAT_HDR,
+		FORMAT_EXR,
+		// CompressedImageData containers
+		FORMAT_DDS,
+		FORMAT_KTX,
+		FORMAT_PKM,
+		FORMAT_ASTC,
+		FORMAT_PVR,
+		FORMAT_MAX_ENUM
+	};
+
+	/**
+	 * Detects image file format from its magic bytes.
+	 * @param data Start of the file.
+	 * @param size Size of data, in bytes.
+	 * @return The file format, or FORMAT_UNKNOWN.
+	 */
+	FileFormat detectFormat(const void *data, size_t size);
+	/**
+	 * Checks whether file should be loaded as CompressedImageData instead of ImageData, without
+	 * trying to decode it. Compressed containers and unknown formats are confirmed with the
+	 * compressed format handlers, as e.g. DDS can also hold formats LOVE doesn't support.
+	 * @param filedata The image file.
+	 * @return true if it's CompressedImageData, false if it's ImageData.
+	 */
+	bool isCompressed(love::filesystem::FileData *filedata);
 	ImageData *newImageData(int width, int height, love::PixelFormat pixfmt = love::PIXELFORMAT_RGBA8);
 	ImageData *newImageData(const std::string &path);
+	/**
+	 * Reads and decodes image in worker thread.
+	 * @param path The file path.
+	 * @return Future of the ImageData.
+	 */
+	job::Future<ImageData> newImageDataAsync(const std::string &path);
 }
 
 namespace keyboard
@@ -553,6 +804,16 @@ namespace timer
 	double step();
 	double getDelta();
 	int getFPS();
+	/**
+	 * Gets high-precision time which can be used to time things.
+	 * @return Time in seconds. The value itself has no meaning, only differences of it.
+	 */
+	double getTime();
+	/**
+	 * Pauses the current thread for the specified amount of time.
+	 * @param seconds Time to sleep, in seconds.
+	 */
+	void sleep(double seconds);
 }
 
 namespace window
@@ -18,8 +18,16 @@
  * 3. This notice may not be removed or altered from any source distribution.
  */
 
+// STL
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
 // lovewrap
 #include "LOVEWrap.h"
+#include "MappedFileData.h"
+#include "Pack.h"
 
 namespace lovewrap
 {
@@ -28,9 +36,336 @@ namespace filesystem
 
 using namespace love::filesystem;
 
+// Directory index of the merged source and save directory and mounted packs.
+// Directory listings and file info are queried from love.filesystem once, then
+// kept until a write through lovewrap (or invalidateIndex) touches the path.
+// Mounting or unmounting a pack invalidates the whole index.
+struct IndexNode
+{
+	std::map<std::string, std::unique_ptr<IndexNode>> children;
+	bool listed;
+	bool hasInfo;
+	bool exists;
+	Filesystem::Info info;
+
+	IndexNode(): listed(false), hasInfo(false), exists(false) {}
+};
+
+static IndexNode indexRoot;
+static std::mutex indexMutex;
+
+static std::vector<std::string> splitPath(const std::string &path)
+{
+	std::vector<std::string> parts;
+	size_t start = 0;
+
+	while (start <= path.length())
+	{
+		size_t end = path.find('/', start);
+		if (end == std::string::npos)
+			end = path.length();
+
+		if (end > start)
+			parts.push_back(path.substr(start, end - start));
+
+		start = end + 1;
+	}
+
+	return parts;
+}
+
+static std::string joinPath(const std::string &dir, const std::string &name)
+{
+	return dir.empty() ? name : dir + "/" + name;
+}
+
+// Must be called with indexMutex locked.
+static void listNode(IndexNode &node, const std::string &path)
+{
+	if (node.listed)
+		return;
+
+	std::vector<std::string> items;
+	std::map<std::string, std::unique_ptr<IndexNode>> children;
+	getInstance()->getDirectoryItems(path.c_str(), items);
+	pack::getDirectoryItems(path, items);
+
+	// Keep what's known about existing children.
+	for (const std::string &name: items)
+	{
+		// Same name in packs and on disk
+		if (children.count(name))
+			continue;
+
+		auto iter = node.children.find(name);
+		if (iter != node.children.end())
+			children[name] = std::move(iter->second);
+		else
+			children[name].reset(new IndexNode());
+	}
+
+	node.children = std::move(children);
+	node.listed = true;
+}
+
+// Must be called with indexMutex locked.
+static const Filesystem::Info *getNodeInfo(IndexNode &node, const std::string &path)
+{
+	if (!node.hasInfo)
+	{
+		// Files in packs come first, like in getInfo.
+		node.exists = path.empty() || pack::getInfo(path, &node.info) || getInstance()->getInfo(path.c_str(), node.info);
+		node.hasInfo = true;
+
+		if (path.empty() || (!node.exists && pack::isDirectory(path)))
+		{
+			node.exists = true;
+			node.info.size = -1;
+			node.info.modtime = -1;
+			node.info.type = Filesystem::FILETYPE_DIRECTORY;
+		}
+	}
+
+	return node.exists ? &node.info : nullptr;
+}
+
+// Must be called with indexMutex locked. Returns nullptr if path doesn't exist.
+static IndexNode *findNode(const std::vector<std::string> &parts, std::string &path)
+{
+	IndexNode *node = &indexRoot;
+	path.clear();
+
+	for (const std::string &part: parts)
+	{
+		listNode(*node, path);
+
+		auto iter = node->children.find(part);
+		if (iter == node->children.end())
+			return nullptr;
+
+		node = iter->second.get();
+		path = joinPath(path, part);
+	}
+
+	return node;
+}
+
+static bool isDirectory(IndexNode &node, const std::string &path)
+{
+	const Filesystem::Info *info = getNodeInfo(node, path);
+	return info && info->type == Filesystem::FILETYPE_DIRECTORY;
+}
+
+// Matches * and ? within a path component.
+static bool matchWildcard(const char *pattern, const char *str)
+{
+	const char *star = nullptr;
+	const char *retry = nullptr;
+
+	while (*str)
+	{
+		if (*pattern == '?' || *pattern == *str)
+		{
+			pattern++;
+			str++;
+		}
+		else if (*pattern == '*')
+		{
+			star = pattern++;
+			retry = str;
+		}
+		else if (star)
+		{
+			pattern = star + 1;
+			str = ++retry;
+		}
+		else
+			return false;
+	}
+
+	while (*pattern == '*')
+		pattern++;
+
+	return *pattern == 0;
+}
+
+// Must be called with indexMutex locked.
+static void globNode(IndexNode &node, const std::string &path, const std::vector<std::string> &parts, size_t i, std::vector<std::string> &out)
+{
+	if (i == parts.size())
+	{
+		if (!path.empty())
+			out.push_back(path);
+
+		return;
+	}
+
+	const std::string &part = parts[i];
+
+	if (part == "**")
+	{
+		// Zero directories
+		globNode(node, path, parts, i + 1, out);
+
+		// One or more directories
+		listNode(node, path);
+		for (auto &child: node.children)
+		{
+			std::string childPath = joinPath(path, child.first);
+			if (isDirectory(*child.second, childPath))
+				globNode(*child.second, childPath, parts, i, out);
+		}
+	}
+	else
+	{
+		bool last = i + 1 == parts.size();
+		listNode(node, path);
+
+		if (part.find_first_of("*?") == std::string::npos)
+		{
+			auto iter = node.children.find(part);
+			std::string childPath = joinPath(path, part);
+
+			if (iter != node.children.end() && (last || isDirectory(*iter->second, childPath)))
+				globNode(*iter->second, childPath, parts, i + 1, out);
+		}
+		else
+		{
+			for (auto &child: node.children)
+			{
+				std::string childPath = joinPath(path, child.first);
+
+				if (matchWildcard(part.c_str(), child.first.c_str()) && (last || isDirectory(*child.second, childPath)))
+					globNode(*child.second, childPath, parts, i + 1, out);
+			}
+		}
+	}
+}
+
+void invalidateIndex(const std::string &path)
+{
+	std::vector<std::string> parts = splitPath(path);
+	std::lock_guard<std::mutex> lock(indexMutex);
+	IndexNode *node = &indexRoot;
+
+	if (parts.empty())
+	{
+		indexRoot.children.clear();
+		indexRoot.listed = false;
+		return;
+	}
+
+	// Ancestors may have been created, and the path itself may have been created or changed.
+	for (const std::string &part: parts)
+	{
+		node->listed = false;
+		node->hasInfo = false;
+
+		auto iter = node->children.find(part);
+		if (iter == node->children.end())
+			return;
+
+		node = iter->second.get();
+	}
+
+	node->listed = false;
+	node->hasInfo = false;
+}
+
+std::vector<std::string> glob(const std::string &pattern)
+{
+	std::vector<std::string> parts = splitPath(pattern);
+	std::vector<std::string> out;
+
+	// Consecutive ** would return same path more than once.
+	parts.erase(std::unique(parts.begin(), parts.end(), [](const std::string &a, const std::string &b)
+	{
+		return a == "**" && b == "**";
+	}), parts.end());
+
+	std::lock_guard<std::mutex> lock(indexMutex);
+	globNode(indexRoot, std::string(), parts, 0, out);
+	return out;
+}
+
+void glob(const std::string &pattern, std::function<void(const std::string&)> callback)
+{
+	// Callback may use the index too, so don't call it with the lock held.
+	for (const std::string &path: glob(pattern))
+		callback(path);
+}
+
+std::vector<std::string> getDirectoryItems(const std::string &dir)
+{
+	std::vector<std::string> items;
+	std::string path;
+	std::lock_guard<std::mutex> lock(indexMutex);
+	IndexNode *node = findNode(splitPath(dir), path);
+
+	if (node)
+	{
+		listNode(*node, path);
+
+		for (auto &child: node->children)
+			items.push_back(child.first);
+	}
+
+	return items;
+}
+
+void getDirectoryItems(const std::string &dir, std::function<void(const std::string&)> callback)
+{
+	for (const std::string &item: getDirectoryItems(dir))
+		callback(item);
+}
+
+bool getInfo(const std::string &path, Filesystem::FileType filtertype, Filesystem::Info *info)
+{
+	Filesystem::Info packInfo;
+	if (pack::getInfo(path, &packInfo))
+	{
+		if (filtertype != Filesystem::FILETYPE_MAX_ENUM && packInfo.type != filtertype)
+			return false;
+
+		if (info)
+			*info = packInfo;
+
+		return true;
+	}
+
+	std::string realPath;
+	std::lock_guard<std::mutex> lock(indexMutex);
+	IndexNode *node = findNode(splitPath(path), realPath);
+
+	if (node == nullptr)
+		return false;
+
+	const Filesystem::Info *nodeInfo = getNodeInfo(*node, realPath);
+	if (nodeInfo == nullptr || (filtertype != Filesystem::FILETYPE_MAX_ENUM && nodeInfo->type != filtertype))
+		return false;
+
+	if (info)
+		*info = *nodeInfo;
+
+	return true;
+}
+
+bool getInfo(const std::string &path, Filesystem::Info *info)
+{
+	return getInfo(path, Filesystem::FILETYPE_MAX_ENUM, info);
+}
+
 void append(const std::string &filename, const void *data, int64_t size)
 {
 	getInstance()->append(filename.c_str(), data, size);
+	invalidateIndex(filename);
+}
+
+bool createDirectory(const std::string &name)
+{
+	bool result = getInstance()->createDirectory(name.c_str());
+	invalidateIndex(name);
+	return result;
 }
 
 bool areSymlinksEnabled()
@@ -43,7 +378,9 @@ std::string getSaveDirectory()
 	return getInstance()->getSaveDirectory();
 }
 
-FileData *newFileData(const std::string &path)
+static size_t mapThreshold = 1024 * 1024;
+
+static FileData *readFileData(const std::string &path)
 {
 	love::StrongRef<love::filesystem::File> f;
 	f.set(getInstance()->newFile(path.c_str()), love::Acquire::NORETAIN);
@@ -54,6 +391,73 @@ FileData *newFileData(const std::string &path)
 	throw love::Exception("Could not open file.");
 }
 
+// Returns nullptr if the file can't be mapped. The file is mapped at its real
+// size, since the indexed size is stale if the file was written since.
+static FileData *tryMapFileData(const std::string &path, int64_t size)
+{
+	std::string realPath = getInstance()->getRealDirectory(path.c_str()) + "/" + path;
+
+	if (!MappedFileData::canMap(realPath))
+		return nullptr;
+
+	love::StrongRef<MappedFileData> fd(new MappedFileData(realPath, 0, MappedFileData::WHOLE_FILE, path), love::Acquire::NORETAIN);
+
+	if ((int64_t) fd->getSize() != size)
+	{
+		invalidateIndex(path);
+		return nullptr;
+	}
+
+	fd->retain();
+	return fd.get();
+}
+
+FileData *newFileData(const std::string &path)
+{
+	Filesystem::Info info;
+	FileData *packed = pack::newFileData(path);
+
+	if (packed)
+		return packed;
+
+	if (mapThreshold > 0 && getInfo(path, Filesystem::FILETYPE_FILE, &info) && info.size >= (int64_t) mapThreshold)
+	{
+		FileData *fd = tryMapFileData(path, info.size);
+		if (fd)
+			return fd;
+	}
+
+	return readFileData(path);
+}
+
+FileData *newMappedFileData(const std::string &path)
+{
+	Filesystem::Info info;
+	FileData *packed = pack::newFileData(path);
+
+	if (packed)
+		return packed;
+
+	if (getInfo(path, Filesystem::FILETYPE_FILE, &info))
+	{
+		FileData *fd = tryMapFileData(path, info.size);
+		if (fd)
+			return fd;
+	}
+
+	return readFileData(path);
+}
+
+void setMapThreshold(size_t bytes)
+{
+	mapThreshold = bytes;
+}
+
+size_t getMapThreshold()
+{
+	return mapThreshold;
+}
+
 FileData *newFileData(const void *contents, size_t len, const std::string &filename)
 {
 	return getInstance()->newFileData(contents, len, filename.c_str());
@@ -64,5 +468,25 @@ FileData *newFileData(const love::Data *data, const std::string &filename)
 	return getInstance()->newFileData(data->getData(), data->getSize(), filename.c_str());
 }
 
+job::Future<FileData> newFileDataAsync(const std::string &path)
+{
+	job::Future<FileData> future;
+
+	job::run([=]()
+	{
+		try
+		{
+			love::StrongRef<FileData> fd(newFileData(path), love::Acquire::NORETAIN);
+			future.setValue(fd);
+		}
+		catch (...)
+		{
+			future.setException(std::current_exception());
+		}
+	});
+
+	return future;
+}
+
 } // filesystem
 } // love
@@ -18,74 +18,680 @@
  * 3. This notice may not be removed or altered from any source distribution.
  */
 
+// STL
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
 // love
 #include "modules/graphics/Graphics.h"
 
 // lovewrap
+#include "Affine2D.h"
 #include "LOVEWrap.h"
+#include "SpriteKernel.h"
 
 namespace lovewrap
 {
 namespace graphics
 {
 
+// Auto-batching. Consecutive textured draws with the same texture, shader,
+// blend mode and color mask are added to one SpriteBatch, with the current
+// transform and color baked in, and drawn as one draw call when anything else
+// is drawn or the state changes.
+struct AutoBatch
+{
+	love::StrongRef<SpriteBatch> batch;
+	// Set to the batch between flushes, as it retains its texture.
+	love::StrongRef<Image> placeholder;
+	Texture *texture;
+	Shader *shader;
+	Graphics::BlendMode blendMode;
+	Graphics::BlendAlpha blendAlpha;
+	Graphics::ColorMask colorMask;
+	bool pending;
+};
+
+static AutoBatch autoBatch;
+static bool autoBatching = false;
+static BatchStats batchStats = {0, 0, 0};
+
+void flushBatch()
+{
+	if (!autoBatch.pending)
+		return;
+
+	Graphics *g = getInstance();
+	love::Colorf color = g->getColor();
+
+	// Transform and color are in the vertices already.
+	autoBatch.pending = false;
+	g->setColor(love::Colorf(1.0f, 1.0f, 1.0f, 1.0f));
+	g->push(STACK_TRANSFORM);
+	g->origin();
+	g->draw(autoBatch.batch, love::Matrix4());
+	g->pop();
+	g->setColor(color);
+
+	autoBatch.batch->clear();
+	batchStats.submitted++;
+
+	// So the last texture can be freed once the game drops it.
+	if (autoBatch.placeholder.get() == nullptr)
+	{
+		love::StrongRef<love::image::ImageData> data(image::newImageData(1, 1), love::Acquire::NORETAIN);
+		autoBatch.placeholder.set(newImage(data.get()), love::Acquire::NORETAIN);
+	}
+
+	autoBatch.batch->setTexture(autoBatch.placeholder);
+}
+
+// Returns false if the draw can't be batched.
+static bool addToBatch(Texture *texture, Quad *quad, const Affine2D *affine, const love::Matrix4 *m)
+{
+	if (!autoBatching || texture->getTextureType() != TEXTURE_2D)
+		return false;
+
+	Graphics *g = getInstance();
+	Canvas *canvas = dynamic_cast<Canvas*>(texture);
+
+	// Drawn directly, so LOVE reports drawing a canvas to itself.
+	if (canvas && g->isCanvasActive(canvas))
+		return false;
+
+	Graphics::BlendAlpha blendAlpha;
+	Graphics::BlendMode blendMode = g->getBlendMode(blendAlpha);
+	Shader *shader = g->getShader();
+	Graphics::ColorMask colorMask = g->getColorMask();
+
+	if (autoBatch.pending && (
+		autoBatch.texture != texture ||
+		autoBatch.shader != shader ||
+		autoBatch.blendMode != blendMode ||
+		autoBatch.blendAlpha != blendAlpha ||
+		autoBatch.colorMask != colorMask
+	))
+		flushBatch();
+
+	if (!autoBatch.pending)
+	{
+		if (autoBatch.batch.get() == nullptr)
+			autoBatch.batch.set(g->newSpriteBatch(texture, 1000, vertex::USAGE_STREAM), love::Acquire::NORETAIN);
+		else if (autoBatch.batch->getTexture() != texture)
+			autoBatch.batch->setTexture(texture);
+
+		autoBatch.texture = texture;
+		autoBatch.shader = shader;
+		autoBatch.blendMode = blendMode;
+		autoBatch.blendAlpha = blendAlpha;
+		autoBatch.colorMask = colorMask;
+		autoBatch.pending = true;
+	}
+
+	// Composing in 2D when possible is cheaper than full Matrix4 multiplication.
+	const love::Matrix4 &current = g->getTransform();
+	love::Matrix4 t;
+
+	if (affine && current.isAffine2DTransform())
+		t = (Affine2D(current) * *affine).toMatrix4();
+	else
+		t = current * (affine ? affine->toMatrix4() : *m);
+
+	autoBatch.batch->setColor(g->getColor());
+
+	if (quad)
+		autoBatch.batch->add(quad, t);
+	else
+		autoBatch.batch->add(t);
+
+	batchStats.batched++;
+	return true;
+}
+
+void setAutoBatch(bool enable)
+{
+	if (!enable)
+		flushBatch();
+
+	autoBatching = enable;
+}
+
+bool isAutoBatch()
+{
+	return autoBatching;
+}
+
+BatchStats getBatchStats()
+{
+	return batchStats;
+}
+
+void resetBatchStats()
+{
+	batchStats.batched = batchStats.submitted = batchStats.unbatched = 0;
+}
+
+namespace shader
+{
+
+// Uniforms of one shader whose value was changed but not uploaded yet. Holds
+// reference to the shader so its UniformInfo stays valid.
+struct StagingBlock
+{
+	love::StrongRef<Shader> shader;
+	std::vector<std::pair<const Shader::UniformInfo*, int>> dirty;
+};
+
+static std::vector<StagingBlock> stagingBlocks;
+static bool staging = true;
+static StagingStats stagingStats = {0, 0, 0};
+
+// Stores new uniform value, then uploads it or marks it dirty. The value is
+// written by the write function, which returns whether the value changed.
+template<typename F>
+static void stageUniform(const Uniform &uniform, int count, F write)
+{
+	if (!write())
+	{
+		stagingStats.skipped++;
+		return;
+	}
+
+	if (!staging)
+	{
+		flushBatch();
+		uniform.shader->updateUniform(uniform.info, count);
+		stagingStats.committed++;
+		return;
+	}
+
+	StagingBlock *block = nullptr;
+	for (StagingBlock &b: stagingBlocks)
+	{
+		if (b.shader.get() == uniform.shader)
+		{
+			block = &b;
+			break;
+		}
+	}
+
+	if (block == nullptr)
+	{
+		stagingBlocks.push_back(StagingBlock());
+		block = &stagingBlocks.back();
+		block->shader.set(uniform.shader);
+	}
+
+	for (auto &d: block->dirty)
+	{
+		if (d.first == uniform.info)
+		{
+			d.second = std::max(d.second, count);
+			stagingStats.coalesced++;
+			return;
+		}
+	}
+
+	block->dirty.push_back(std::make_pair(uniform.info, count));
+}
+
+// Copies value, returns whether it's different.
+static bool writeUniform(void *dest, const void *src, size_t size)
+{
+	if (memcmp(dest, src, size) == 0)
+		return false;
+
+	memcpy(dest, src, size);
+	return true;
+}
+
+void setStaging(bool enable)
+{
+	if (!enable)
+	{
+		while (!stagingBlocks.empty())
+			commit(stagingBlocks.back().shader.get());
+	}
+
+	staging = enable;
+}
+
+bool isStaging()
+{
+	return staging;
+}
+
+void commit(Shader *shader)
+{
+	if (stagingBlocks.empty())
+		return;
+
+	if (shader == nullptr)
+	{
+		shader = getInstance()->getShader();
+		if (shader == nullptr)
+			return;
+	}
+
+	for (size_t i = 0; i < stagingBlocks.size(); i++)
+	{
+		StagingBlock &block = stagingBlocks[i];
+
+		if (block.shader.get() == shader)
+		{
+			// Batched sprites use the old values.
+			flushBatch();
+
+			for (auto &d: block.dirty)
+				shader->updateUniform(d.first, d.second);
+
+			stagingStats.committed += block.dirty.size();
+			std::swap(block, stagingBlocks.back());
+			stagingBlocks.pop_back();
+			return;
+		}
+	}
+}
+
+// Forgets staged values of shaders nobody else references anymore.
+static void discardUnusedStaging()
+{
+	for (size_t i = stagingBlocks.size(); i > 0; i--)
+	{
+		if (stagingBlocks[i - 1].shader->getReferenceCount() == 1)
+		{
+			std::swap(stagingBlocks[i - 1], stagingBlocks.back());
+			stagingBlocks.pop_back();
+		}
+	}
+}
+
+StagingStats getStagingStats()
+{
+	return stagingStats;
+}
+
+void resetStagingStats()
+{
+	stagingStats.skipped = stagingStats.coalesced = stagingStats.committed = 0;
+}
+
+} // shader
+
+// Called by draw functions before drawing anything.
+static inline void prepareDraw()
+{
+	flushBatch();
+	shader::commit();
+	batchStats.unbatched++;
+}
+
 void circle(Graphics::DrawMode mode, float x, float y, float r)
 {
+	prepareDraw();
 	getInstance()->circle(mode, x, y, r);
 }
 
 void circle(Graphics::DrawMode mode, float x, float y, float r, int segments)
 {
+	prepareDraw();
 	getInstance()->circle(mode, x, y, r, segments);
 }
 
 void clear(love::Colorf color, bool clearstencil, bool cleardepth)
 {
+	flushBatch();
 	getInstance()->clear(love::graphics::OptionalColorf(color), clearstencil, cleardepth);
 }
 
+// Draws through auto-batch when possible. Either affine or m is used.
+static void drawTexture(Drawable *drawable, Texture *texture, Quad *quad, const Affine2D *affine, const love::Matrix4 *m)
+{
+	if (texture)
+	{
+		shader::commit();
+		if (addToBatch(texture, quad, affine, m))
+			return;
+	}
+
+	prepareDraw();
+
+	love::Matrix4 local = affine ? affine->toMatrix4() : *m;
+
+	if (quad)
+		getInstance()->draw(texture, quad, local);
+	else
+		getInstance()->draw(drawable, local);
+}
+
 void draw(Drawable *drawable, float x, float y, float r, float sx, float sy, float ox, float oy, float kx, float ky)
 {
-	getInstance()->draw(drawable, love::Matrix4(x, y, r, sx, sy, ox, oy, kx, ky));
+	Texture *texture = autoBatching ? dynamic_cast<Texture*>(drawable) : nullptr;
+	Affine2D affine = makeAffine(x, y, r, sx, sy, ox, oy, kx, ky);
+	drawTexture(drawable, texture, nullptr, &affine, nullptr);
 }
 
 void draw(Drawable *drawable, love::math::Transform *transform)
 {
-	getInstance()->draw(drawable, transform->getMatrix());
+	Texture *texture = autoBatching ? dynamic_cast<Texture*>(drawable) : nullptr;
+	drawTexture(drawable, texture, nullptr, nullptr, &transform->getMatrix());
 }
 
 void draw(Texture *texture, Quad *quad, float x, float y, float r, float sx, float sy, float ox, float oy, float kx, float ky)
 {
-	getInstance()->draw(texture, quad, love::Matrix4(x, y, r, sx, sy, ox, oy, kx, ky));
+	Affine2D affine = makeAffine(x, y, r, sx, sy, ox, oy, kx, ky);
+	drawTexture(texture, texture, quad, &affine, nullptr);
 }
 
 void draw(Texture *texture, Quad *quad, love::math::Transform *transform)
 {
-	getInstance()->draw(texture, quad, transform->getMatrix());
+	drawTexture(texture, texture, quad, nullptr, &transform->getMatrix());
+}
+
+void drawMany(Texture *texture, Span<Quad*> quads, const SpriteArrays &sprites)
+{
+	// Sprites per draw request, within limits of the streaming buffer.
+	static const size_t CHUNK_SIZE = 2048;
+
+	Graphics *g = getInstance();
+	size_t count = sprites.x.size;
+	std::vector<sprite::QuadInfo> quadInfos;
+
+	if (count == 0)
+		return;
+
+	if (quads.size == 0)
+		quadInfos.push_back(sprite::getQuadInfo(texture->getQuad()));
+	else
+	{
+		for (Quad *q: quads)
+			quadInfos.push_back(sprite::getQuadInfo(q));
+	}
+
+	// Checked before anything is drawn.
+	if (
+		sprites.y.size != count ||
+		(sprites.rotation.size != 0 && sprites.rotation.size != count) ||
+		(sprites.scaleX.size != 0 && sprites.scaleX.size != count) ||
+		(sprites.scaleY.size != 0 && sprites.scaleY.size != count) ||
+		(sprites.quad.size != 0 && sprites.quad.size != count) ||
+		(sprites.color.size != 0 && sprites.color.size != count)
+	)
+		throw love::Exception("Sprite arrays must be empty or have %d elements.", (int) count);
+
+	for (uint16_t q: sprites.quad)
+	{
+		if (q >= quadInfos.size())
+			throw love::Exception("Invalid quad index %d.", (int) q);
+	}
+
+	prepareDraw();
+
+	const love::Matrix4 &current = g->getTransform();
+
+	// Vertices are 2D, so 3D transforms draw one by one.
+	if (!current.isAffine2DTransform() || texture->getTextureType() != TEXTURE_2D)
+	{
+		love::Colorf color = g->getColor();
+
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t q = sprites.quad.size ? sprites.quad[i] : 0;
+
+			if (sprites.color.size)
+			{
+				love::Color32 c = sprites.color[i];
+				g->setColor(love::Colorf(color.r * c.r / 255.0f, color.g * c.g / 255.0f, color.b * c.b / 255.0f, color.a * c.a / 255.0f));
+			}
+
+			float r = sprites.rotation.size ? sprites.rotation[i] : 0.0f;
+			float sx = sprites.scaleX.size ? sprites.scaleX[i] : 1.0f;
+			float sy = sprites.scaleY.size ? sprites.scaleY[i] : sx;
+			love::Matrix4 m = makeAffine(sprites.x[i], sprites.y[i], r, sx, sy, sprites.ox, sprites.oy, 0.0f, 0.0f).toMatrix4();
+			g->draw(texture, quads.size ? quads[q] : texture->getQuad(), m);
+		}
+
+		g->setColor(color);
+		return;
+	}
+
+	Affine2D transform(current);
+	love::Colorf color = g->getColor();
+
+	for (size_t first = 0; first < count; first += CHUNK_SIZE)
+	{
+		size_t n = std::min(CHUNK_SIZE, count - first);
+
+		Graphics::StreamDrawCommand cmd;
+		cmd.formats[0] = vertex::CommonFormat::XYf_STf_RGBAub;
+		cmd.formats[1] = vertex::CommonFormat::NONE;
+		cmd.indexMode = vertex::TriangleIndexMode::QUADS;
+		cmd.vertexCount = (int) n * 4;
+		cmd.texture = texture;
+
+		Graphics::StreamVertexData data = g->requestStreamDraw(cmd);
+		sprite::generateVertices(transform, color, sprites, first, n, quadInfos.data(), quadInfos.size(), (sprite::Vertex *) data.stream[0]);
+	}
 }
 
 void points(const love::Vector2 *pos, const love::Colorf *cols, size_t amount)
 {
+	prepareDraw();
 	getInstance()->points(pos, cols, amount);
 }
 
+// Text cache. Entries are keyed by hash of font, strings and colors, and
+// evicted by present when they haven't been printed for textCacheFrames.
+struct TextCacheEntry
+{
+	love::StrongRef<Font> font;
+	std::vector<Font::ColoredString> strings;
+	love::StrongRef<Text> text;
+	uint64_t lastFrame;
+};
+
+static std::unordered_multimap<uint64_t, TextCacheEntry> textCache;
+// Text objects of evicted entries, by font
+static std::unordered_map<Font*, std::vector<love::StrongRef<Text>>> textPool;
+static const size_t TEXT_POOL_SIZE = 16;
+static int textCacheFrames = 4;
+static uint64_t textFrame = 0;
+
+static const love::Colorf WHITE(1.0f, 1.0f, 1.0f, 1.0f);
+
+static uint64_t hashBytes(uint64_t h, const void *data, size_t size)
+{
+	const uint8_t *bytes = (const uint8_t *) data;
+
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ bytes[i]) * 1099511628211ULL;
+
+	return h;
+}
+
+static uint64_t hashColoredString(uint64_t h, const std::string &str, const love::Colorf &color)
+{
+	h = hashBytes(h, &color, sizeof(love::Colorf));
+	h = hashBytes(h, str.c_str(), str.length());
+	// Separator
+	return (h ^ 0xFFULL) * 1099511628211ULL;
+}
+
+static bool equalColor(const love::Colorf &a, const love::Colorf &b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static bool equalStrings(const std::vector<Font::ColoredString> &strings, const std::string *text, const std::vector<Font::ColoredString> *coloredText)
+{
+	if (text)
+		return strings.size() == 1 && equalColor(strings[0].color, WHITE) && strings[0].str == *text;
+
+	if (strings.size() != coloredText->size())
+		return false;
+
+	for (size_t i = 0; i < strings.size(); i++)
+	{
+		if (!equalColor(strings[i].color, (*coloredText)[i].color) || strings[i].str != (*coloredText)[i].str)
+			return false;
+	}
+
+	return true;
+}
+
+// Either text (in white) or coloredText is used. Returns cached Text, or
+// creates one. Doesn't allocate when it's cached.
+static Text *getCachedText(Font *font, const std::string *text, const std::vector<Font::ColoredString> *coloredText)
+{
+	uint64_t h = hashBytes(14695981039346656037ULL, &font, sizeof(Font*));
+
+	if (text)
+		h = hashColoredString(h, *text, WHITE);
+	else
+	{
+		for (const Font::ColoredString &cs: *coloredText)
+			h = hashColoredString(h, cs.str, cs.color);
+	}
+
+	auto range = textCache.equal_range(h);
+	for (auto iter = range.first; iter != range.second; ++iter)
+	{
+		TextCacheEntry &e = iter->second;
+
+		if (e.font.get() == font && equalStrings(e.strings, text, coloredText))
+		{
+			e.lastFrame = textFrame;
+			return e.text;
+		}
+	}
+
+	TextCacheEntry e;
+	e.font.set(font);
+	e.lastFrame = textFrame;
+
+	if (text)
+		e.strings.push_back({*text, WHITE});
+	else
+		e.strings = *coloredText;
+
+	// Reuse Text of evicted entry.
+	auto pool = textPool.find(font);
+	if (pool != textPool.end() && !pool->second.empty())
+	{
+		e.text = pool->second.back();
+		pool->second.pop_back();
+		e.text->set(e.strings);
+	}
+	else
+		e.text.set(getInstance()->newText(font, e.strings), love::Acquire::NORETAIN);
+
+	return textCache.insert(std::make_pair(h, e))->second.text;
+}
+
+// Called by present.
+static void evictTextCache()
+{
+	textFrame++;
+
+	for (auto iter = textCache.begin(); iter != textCache.end();)
+	{
+		TextCacheEntry &e = iter->second;
+
+		if (textFrame - e.lastFrame > (uint64_t) textCacheFrames)
+		{
+			std::vector<love::StrongRef<Text>> &pool = textPool[e.font.get()];
+			if (pool.size() < TEXT_POOL_SIZE && e.font->getReferenceCount() > 2)
+				pool.push_back(e.text);
+
+			iter = textCache.erase(iter);
+		}
+		else
+			++iter;
+	}
+
+	// Drop pools of fonts which are only referenced by pooled Texts.
+	for (auto iter = textPool.begin(); iter != textPool.end();)
+	{
+		if (iter->second.empty() || iter->first->getReferenceCount() <= (int) iter->second.size())
+			iter = textPool.erase(iter);
+		else
+			++iter;
+	}
+}
+
+static void printText(const std::string *text, const std::vector<Font::ColoredString> *coloredText, const love::Matrix4 &m)
+{
+	Graphics *g = getInstance();
+	prepareDraw();
+
+	if (textCacheFrames <= 0)
+	{
+		if (text)
+			g->print({{*text, WHITE}}, m);
+		else
+			g->print(*coloredText, m);
+
+		return;
+	}
+
+	g->draw(getCachedText(g->getFont(), text, coloredText), m);
+}
+
 void present()
 {
+	flushBatch();
+	evictTextCache();
+	shader::discardUnusedStaging();
 	getInstance()->present(nullptr);
 }
 
 void print(const std::string &text, float x, float y, float r, float sx, float sy, float ox, float oy, float kx, float ky)
 {
-	getInstance()->print({{text, {1.0f, 1.0f, 1.0f, 1.0f}}}, love::Matrix4(x, y, r, sx, sy, ox, oy, kx, ky));
+	printText(&text, nullptr, makeAffine(x, y, r, sx, sy, ox, oy, kx, ky).toMatrix4());
+}
+
+void print(const std::vector<Font::ColoredString> &coloredText, float x, float y, float r, float sx, float sy, float ox, float oy, float kx, float ky)
+{
+	printText(nullptr, &coloredText, makeAffine(x, y, r, sx, sy, ox, oy, kx, ky).toMatrix4());
+}
+
+void print(const std::string &text, const love::math::Transform &transform)
+{
+	printText(&text, nullptr, transform.getMatrix());
+}
+
+void print(const std::vector<Font::ColoredString> &coloredText, const love::math::Transform &transform)
+{
+	printText(nullptr, &coloredText, transform.getMatrix());
+}
+
+void setTextCacheFrames(int frames)
+{
+	textCacheFrames = frames;
+
+	if (frames <= 0)
+	{
+		textCache.clear();
+		textPool.clear();
+	}
+}
+
+int getTextCacheFrames()
+{
+	return textCacheFrames;
 }
 
 void rectangle(Graphics::DrawMode mode, float x, float y, float w, float h)
 {
+	prepareDraw();
 	getInstance()->rectangle(mode, x, y, w, h);
 }
 
 void rectangle(Graphics::DrawMode mode, float x, float y, float w, float h, float rx, float ry)
 {
+	prepareDraw();
 	getInstance()->rectangle(mode, x, y, w, h, rx, ry);
 }
 
@@ -126,6 +732,8 @@ void origin()
 
 void pop()
 {
+	// Popping may restore shader, canvas and blend mode.
+	flushBatch();
 	return getInstance()->pop();
 }
 
@@ -159,13 +767,45 @@ Font *newFont(int32_t size)
 	return ret;
 }
 
+Font *newFont(const std::string &filename, int size)
+{
+	love::StrongRef<love::filesystem::FileData> fd(lovewrap::filesystem::newFileData(filename), love::Acquire::NORETAIN);
+	auto finst = lovewrap::font::getInstance();
+	love::StrongRef<love::font::Rasterizer> rast(
+		finst->newTrueTypeRasterizer(fd, size, love::font::TrueTypeRasterizer::HINTING_NORMAL),
+		love::Acquire::NORETAIN
+	);
+	return getInstance()->newFont(rast);
+}
+
+Font *newFont(love::filesystem::File *file, int size)
+{
+	if (!file->isOpen())
+	{
+		if (!file->open(love::filesystem::File::Mode::MODE_READ))
+			throw love::Exception("Could not open file.");
+	}
+	else
+		file->seek(0);
+
+	love::StrongRef<love::filesystem::FileData> fd(file->read(), love::Acquire::NORETAIN);
+	auto finst = lovewrap::font::getInstance();
+	love::StrongRef<love::font::Rasterizer> rast(
+		finst->newTrueTypeRasterizer(fd, size, love::font::TrueTypeRasterizer::HINTING_NORMAL),
+		love::Acquire::NORETAIN
+	);
+	return getInstance()->newFont(rast);
+}
+
 Image *newImage(const std::string& filename, const Image::Settings *settings)
 {
-	auto lfs = lovewrap::filesystem::getInstance();
-	auto f = lfs->newFile(filename.c_str());
-	auto out = newImage(f, settings);
-	f->release();
-	return out;
+	// File can't be opened
+	if (!lovewrap::filesystem::getInfo(filename, love::filesystem::Filesystem::FILETYPE_FILE, nullptr))
+		return nullptr;
+
+	// Through lovewrap, so packs and memory mapping are used.
+	love::StrongRef<love::filesystem::FileData> fd(lovewrap::filesystem::newFileData(filename), love::Acquire::NORETAIN);
+	return newImage(fd, settings);
 }
 
 Image *newImage(love::filesystem::File *file, const Image::Settings *settings)
@@ -194,21 +834,15 @@ Image *newImage(love::filesystem::FileData *filedata, const Image::Settings *set
 {
 	auto li = lovewrap::image::getInstance();
 
-	// Try CompressedImageData
-	try
+	if (lovewrap::image::isCompressed(filedata))
 	{
-		love::image::CompressedImageData *img = li->newCompressedData(filedata);
-		auto out = newImage(img, settings);
-		img->release();
-		return out;
+		love::StrongRef<love::image::CompressedImageData> img(li->newCompressedData(filedata), love::Acquire::NORETAIN);
+		return newImage(img, settings);
 	}
-	// Try ImageData
-	catch (love::Exception &)
+	else
 	{
-		love::image::ImageData *img = li->newImageData(filedata);
-		auto out = newImage(img, settings);
-		img->release();
-		return out;
+		love::StrongRef<love::image::ImageData> img(li->newImageData(filedata), love::Acquire::NORETAIN);
+		return newImage(img, settings);
 	}
 }
 
@@ -250,6 +884,65 @@ Image *newImage(love::image::CompressedImageData *cimgd, const Image::Settings *
 	return out;
 }
 
+job::Future<Image> newImageAsync(const std::string &filename, const Image::Settings *settings)
+{
+	job::Future<Image> future;
+	bool hasSettings = settings != nullptr;
+	Image::Settings settingsCopy;
+
+	if (hasSettings)
+		settingsCopy = *settings;
+
+	job::run([=]()
+	{
+		try
+		{
+			// Read and decode in worker thread
+			love::StrongRef<love::filesystem::FileData> fd(lovewrap::filesystem::newFileData(filename), love::Acquire::NORETAIN);
+			auto li = lovewrap::image::getInstance();
+			bool compressed = lovewrap::image::isCompressed(fd);
+			love::StrongRef<love::Data> data;
+
+			if (compressed)
+				data.set(li->newCompressedData(fd), love::Acquire::NORETAIN);
+			else
+				data.set(li->newImageData(fd), love::Acquire::NORETAIN);
+
+			// Then upload in main thread
+			job::runOnMainThread([=]()
+			{
+				try
+				{
+					const Image::Settings *s = hasSettings ? &settingsCopy : nullptr;
+					Image *img = nullptr;
+
+					if (compressed)
+						img = newImage(static_cast<love::image::CompressedImageData*>(data.get()), s);
+					else
+						img = newImage(static_cast<love::image::ImageData*>(data.get()), s);
+
+					future.setValue(img);
+					img->release();
+				}
+				catch (...)
+				{
+					future.setException(std::current_exception());
+				}
+			},
+			[=]()
+			{
+				future.setException(std::make_exception_ptr(love::Exception("Image upload cancelled.")));
+			});
+		}
+		catch (...)
+		{
+			future.setException(std::current_exception());
+		}
+	});
+
+	return future;
+}
+
 Mesh *newMesh(const std::vector<Mesh::AttribFormat> &vertexformat, int vertexcount, PrimitiveType drawmode, vertex::Usage usage)
 {
 	return getInstance()->newMesh(vertexformat, vertexcount, drawmode, usage);
@@ -263,62 +956,172 @@ Mesh *newMesh(const std::vector<Mesh::AttribFormat> &vertexformat, const void *d
 namespace shader
 {
 
-void sendBools(Shader *shader, const std::string &name, std::initializer_list<bool> values)
+static const char *getUniformTypeName(Shader::UniformType type)
 {
-	const Shader::UniformInfo *info = shader->getUniformInfo(name);
-	if (info == nullptr)
-		throw love::Exception("Shader uniform '%s' does not exist.\nA common error is to define but not use the variable.", name.c_str());
-	else if (info->baseType != Shader::UNIFORM_BOOL)
-		throw love::Exception("Uniform does not accept boolean.");
+	switch (type)
+	{
+		case Shader::UNIFORM_FLOAT:
+			return "float";
+		case Shader::UNIFORM_MATRIX:
+			return "matrix";
+		case Shader::UNIFORM_INT:
+			return "int";
+		case Shader::UNIFORM_UINT:
+			return "unsigned int";
+		case Shader::UNIFORM_BOOL:
+			return "boolean";
+		case Shader::UNIFORM_SAMPLER:
+			return "texture";
+		default:
+			return "unknown";
+	}
+}
 
-	// Convert int to bool
-	std::vector<int> boolArray;
-	for (bool b: values)
-		boolArray.push_back((int) b);
+inline void checkUniformType(const Uniform &uniform, Shader::UniformType type)
+{
+	if (uniform.info->baseType != type)
+		throw love::Exception("Uniform does not accept %s.", getUniformTypeName(type));
+}
 
-	// Check size
-	if (boolArray.size() % ((size_t) info->components) != 0)
-		throw love::Exception("Passed value is not divisible by %d", info->components);
+// Returns amount of array elements to update.
+inline int getElementCount(const Shader::UniformInfo *info, size_t count, int components)
+{
+	if (count % (size_t) components != 0)
+		throw love::Exception("Passed value is not divisible by %d", components);
 
-	// Then copy
-	int maxsize = std::min(info->count * info->components, (int) boolArray.size());
-	memcpy(info->ints, boolArray.data(), maxsize * sizeof(int));
-	shader->updateUniform(info, maxsize / info->components);
+	return (int) std::min((size_t) info->count, count / (size_t) components);
 }
 
-void sendFloats(Shader *shader, const std::string &name, std::initializer_list<float> values)
+Uniform getUniform(Shader *shader, const std::string &name, Shader::UniformType type)
 {
 	const Shader::UniformInfo *info = shader->getUniformInfo(name);
 	if (info == nullptr)
 		throw love::Exception("Shader uniform '%s' does not exist.\nA common error is to define but not use the variable.", name.c_str());
-	else if (info->baseType != Shader::UNIFORM_FLOAT)
-		throw love::Exception("Uniform does not accept float.");
 
-	std::vector<float> floatArray = values;
+	Uniform uniform = {shader, info};
+	checkUniformType(uniform, type);
+	return uniform;
+}
 
-	// Check size
-	if (floatArray.size() % ((size_t) info->components) != 0)
-		throw love::Exception("Passed value is not divisible by %d", info->components);
-	
-	// Then copy
-	int maxsize = std::min(info->count * info->components, (int) floatArray.size());
-	memcpy(info->floats, floatArray.data(), maxsize * sizeof(float));
-	shader->updateUniform(info, maxsize / info->components);
+void sendBools(const Uniform &uniform, Span<bool> values)
+{
+	checkUniformType(uniform, Shader::UNIFORM_BOOL);
+
+	const Shader::UniformInfo *info = uniform.info;
+	int count = getElementCount(info, values.size, info->components);
+	int size = count * info->components;
+
+	stageUniform(uniform, count, [&]() -> bool
+	{
+		// Booleans are stored as int
+		bool changed = false;
+
+		for (int i = 0; i < size; i++)
+		{
+			if (info->ints[i] != (int) values[i])
+			{
+				info->ints[i] = (int) values[i];
+				changed = true;
+			}
+		}
+
+		return changed;
+	});
+}
+
+void sendInts(const Uniform &uniform, Span<int> values)
+{
+	checkUniformType(uniform, Shader::UNIFORM_INT);
+
+	const Shader::UniformInfo *info = uniform.info;
+	int count = getElementCount(info, values.size, info->components);
+	stageUniform(uniform, count, [&]() -> bool
+	{
+		return writeUniform(info->ints, values.data, count * info->components * sizeof(int));
+	});
+}
+
+void sendUInts(const Uniform &uniform, Span<unsigned int> values)
+{
+	checkUniformType(uniform, Shader::UNIFORM_UINT);
+
+	const Shader::UniformInfo *info = uniform.info;
+	int count = getElementCount(info, values.size, info->components);
+	stageUniform(uniform, count, [&]() -> bool
+	{
+		return writeUniform(info->uints, values.data, count * info->components * sizeof(unsigned int));
+	});
+}
+
+void sendFloats(const Uniform &uniform, Span<float> values)
+{
+	checkUniformType(uniform, Shader::UNIFORM_FLOAT);
+
+	const Shader::UniformInfo *info = uniform.info;
+	int count = getElementCount(info, values.size, info->components);
+	stageUniform(uniform, count, [&]() -> bool
+	{
+		return writeUniform(info->floats, values.data, count * info->components * sizeof(float));
+	});
+}
+
+void sendMatrices(const Uniform &uniform, Span<float> values)
+{
+	checkUniformType(uniform, Shader::UNIFORM_MATRIX);
+
+	const Shader::UniformInfo *info = uniform.info;
+	int components = info->matrix.rows * info->matrix.columns;
+	int count = getElementCount(info, values.size, components);
+	stageUniform(uniform, count, [&]() -> bool
+	{
+		return writeUniform(info->floats, values.data, count * components * sizeof(float));
+	});
+}
+
+void sendTextures(const Uniform &uniform, Span<Texture*> values)
+{
+	checkUniformType(uniform, Shader::UNIFORM_SAMPLER);
+
+	const Shader::UniformInfo *info = uniform.info;
+	int count = std::min(info->count, (int) values.size);
+
+	for (int i = 0; i < count; i++)
+	{
+		if (values[i]->getTextureType() != info->textureType)
+			throw love::Exception("Invalid texture type for uniform at #%d", i + 1);
+	}
+
+	flushBatch();
+	uniform.shader->sendTextures(info, const_cast<Texture**>(values.data), count);
+}
+
+void sendBools(Shader *shader, const std::string &name, std::initializer_list<bool> values)
+{
+	sendBools(getUniform(shader, name, Shader::UNIFORM_BOOL), values);
+}
+
+void sendInts(Shader *shader, const std::string &name, std::initializer_list<int> values)
+{
+	sendInts(getUniform(shader, name, Shader::UNIFORM_INT), values);
+}
+
+void sendUInts(Shader *shader, const std::string &name, std::initializer_list<unsigned int> values)
+{
+	sendUInts(getUniform(shader, name, Shader::UNIFORM_UINT), values);
+}
+
+void sendFloats(Shader *shader, const std::string &name, std::initializer_list<float> values)
+{
+	sendFloats(getUniform(shader, name, Shader::UNIFORM_FLOAT), values);
 }
 
 void sendMatrix(Shader *shader, const std::string &name, int rows, int columns, const float *data)
 {
-	const Shader::UniformInfo *info = shader->getUniformInfo(name);
-	if (info == nullptr)
-		throw love::Exception("Shader uniform '%s' does not exist.\nA common error is to define but not use the variable.", name.c_str());
-	else if (info->baseType != Shader::UNIFORM_MATRIX)
-		throw love::Exception("Uniform does not accept matrix.");
-	else if (info->matrix.rows != rows || info->matrix.columns != columns)
+	Uniform uniform = getUniform(shader, name, Shader::UNIFORM_MATRIX);
+	if (uniform.info->matrix.rows != rows || uniform.info->matrix.columns != columns)
 		throw love::Exception("Matrix does not have %d rows or %d columns", rows, columns);
-	
-	// Then copy
-	memcpy(info->floats, data, rows * columns * sizeof(float));
-	shader->updateUniform(info, info->count);
+
+	sendMatrices(uniform, Span<float>(data, (size_t) (rows * columns)));
 }
 
 void sendMat3(Shader *shader, const std::string &name, const love::Matrix3 &matrix)
@@ -326,6 +1129,11 @@ void sendMat3(Shader *shader, const std::string &name, const love::Matrix3 &matr
 	return sendMatrix(shader, name, 3, 3, matrix.getElements());
 }
 
+void sendMat4(Shader *shader, const std::string &name, const love::math::Transform *transform)
+{
+	return sendMatrix(shader, name, 4, 4, transform->getMatrix().getElements());
+}
+
 void sendMat4(Shader *shader, const std::string &name, const love::Matrix4 &matrix)
 {
 	return sendMatrix(shader, name, 4, 4, matrix.getElements());
@@ -333,27 +1141,7 @@ void sendMat4(Shader *shader, const std::string &name, const love::Matrix4 &matr
 
 void sendTextures(Shader *shader, const std::string &name, std::initializer_list<Texture*> values)
 {
-	const Shader::UniformInfo *info = shader->getUniformInfo(name);
-	if (info == nullptr)
-		throw love::Exception("Shader uniform '%s' does not exist.\nA common error is to define but not use the variable.", name.c_str());
-	else if (info->baseType != Shader::UNIFORM_SAMPLER)
-		throw love::Exception("Uniform does not accept texture.");
-
-	std::vector<Texture*> textures;
-	textures.reserve((size_t) info->count);
-
-	int i = 0;
-	for (Texture *tex: values)
-	{
-		++i;
-
-		if (tex->getTextureType() != info->textureType)
-			throw love::Exception("Invalid texture type for uniform at #%d", i);
-
-		textures.push_back(tex);
-	}
-
-	shader->sendTextures(info, textures.data(), (int) textures.size());
+	sendTextures(getUniform(shader, name, Shader::UNIFORM_SAMPLER), values);
 }
 
 } // shader
@@ -400,11 +1188,13 @@ bool isActive()
 
 void setBlendMode(Graphics::BlendMode blendMode, Graphics::BlendAlpha alphaMode)
 {
+	flushBatch();
 	getInstance()->setBlendMode(blendMode, alphaMode);
 }
 
 void setCanvas(Canvas *canvas)
 {
+	flushBatch();
 	auto inst = getInstance();
 	inst->stopDrawToStencilBuffer();
 
@@ -420,6 +1210,7 @@ void setCanvas(Canvas *canvas)
 
 void setCanvas(Graphics::RenderTargetsStrongRef &rts)
 {
+	flushBatch();
 	auto inst = getInstance();
 	inst->stopDrawToStencilBuffer();
 	inst->setCanvas(rts);
@@ -427,6 +1218,7 @@ void setCanvas(Graphics::RenderTargetsStrongRef &rts)
 
 void setCanvas(Graphics::RenderTargets &rts)
 {
+	flushBatch();
 	auto inst = getInstance();
 	inst->stopDrawToStencilBuffer();
 	inst->setCanvas(rts);
@@ -444,16 +1236,19 @@ void setColor(love::Colorf color)
 
 void setDepthMode(CompareMode mode, bool value)
 {
+	flushBatch();
 	getInstance()->setDepthMode(mode, value);
 }
 
 void setDepthMode()
 {
+	flushBatch();
 	getInstance()->setDepthMode();
 }
 
 void setMeshCullMode(CullMode mode)
 {
+	flushBatch();
 	getInstance()->setMeshCullMode(mode);
 }
 
@@ -464,11 +1259,13 @@ void setPointSize(float pz)
 
 void setShader(Shader *shader)
 {
+	flushBatch();
 	getInstance()->setShader(shader);
 }
 
 void setWireframe(bool wireframe)
 {
+	flushBatch();
 	getInstance()->setWireframe(wireframe);
 }
 
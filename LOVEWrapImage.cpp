@@ -18,6 +18,9 @@
  * 3. This notice may not be removed or altered from any source distribution.
  */
 
+// STL
+#include <cstring>
+
 // love
 #include "modules/image/Image.h"
 
@@ -29,6 +32,57 @@ namespace lovewrap
 namespace image
 {
 
+struct Magic
+{
+	FileFormat format;
+	size_t offset;
+	size_t length;
+	const char *bytes;
+};
+
+// Ordered by how common the format is.
+static const Magic magics[] = {
+	{FORMAT_PNG, 0, 8, "\x89PNG\r\n\x1A\n"},
+	{FORMAT_JPEG, 0, 3, "\xFF\xD8\xFF"},
+	{FORMAT_DDS, 0, 4, "DDS "},
+	{FORMAT_KTX, 0, 12, "\xABKTX 11\xBB\r\n\x1A\n"},
+	{FORMAT_PKM, 0, 4, "PKM "},
+	{FORMAT_ASTC, 0, 4, "\x13\xAB\xA1\x5C"},
+	{FORMAT_PVR, 0, 4, "PVR\x03"},
+	{FORMAT_PVR, 0, 4, "\x03RVP"}, // Big endian
+	{FORMAT_PVR, 44, 4, "PVR!"},    // Version 2
+	{FORMAT_EXR, 0, 4, "\x76\x2F\x31\x01"},
+	{FORMAT_BMP, 0, 2, "BM"},
+	{FORMAT_GIF, 0, 4, "GIF8"},
+	{FORMAT_PSD, 0, 4, "8BPS"},
+	{FORMAT_HDR, 0, 10, "#?RADIANCE"},
+	{FORMAT_HDR, 0, 6, "#?RGBE"},
+};
+
+FileFormat detectFormat(const void *data, size_t size)
+{
+	const char *bytes = (const char *) data;
+
+	for (const Magic &m: magics)
+	{
+		if (size >= m.offset + m.length && memcmp(bytes + m.offset, m.bytes, m.length) == 0)
+			return m.format;
+	}
+
+	return FORMAT_UNKNOWN;
+}
+
+bool isCompressed(love::filesystem::FileData *filedata)
+{
+	FileFormat format = detectFormat(filedata->getData(), filedata->getSize());
+
+	if (format != FORMAT_UNKNOWN && format < FORMAT_DDS)
+		return false;
+
+	// Asks each handler, without decoding.
+	return getInstance()->isCompressed(filedata);
+}
+
 ImageData *newImageData(int width, int height, love::PixelFormat pixfmt)
 {
 	return getInstance()->newImageData(width, height, pixfmt);
@@ -40,5 +94,25 @@ ImageData *newImageData(const std::string &path)
 	return getInstance()->newImageData(fd);
 }
 
+job::Future<ImageData> newImageDataAsync(const std::string &path)
+{
+	job::Future<ImageData> future;
+
+	job::run([=]()
+	{
+		try
+		{
+			love::StrongRef<ImageData> imgd(newImageData(path), love::Acquire::NORETAIN);
+			future.setValue(imgd);
+		}
+		catch (...)
+		{
+			future.setException(std::current_exception());
+		}
+	});
+
+	return future;
+}
+
 } // image
 } // lovewrap
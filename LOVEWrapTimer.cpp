@@ -40,5 +40,16 @@ int getFPS()
 	return getInstance()->getFPS();
 }
 
+double getTime()
+{
+	// Timer::getTime is static, so this works even without love.timer loaded.
+	return Timer::getTime();
+}
+
+void sleep(double seconds)
+{
+	getInstance()->sleep(seconds);
+}
+
 }
 }
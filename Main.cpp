@@ -30,6 +30,8 @@ extern "C" {
 #include "modules/love/love.h"
 
 // lovewrap
+#include "lovewrap/CommandList.h"
+#include "lovewrap/Job.h"
 #include "lovewrap/LOVEWrap.h"
 #include "lovewrap/Scene.h"
 
@@ -53,6 +55,7 @@ int runGame(int argc, char *argv[])
 	lua_State *L = luaL_newstate();
 	luaL_openlibs(L);
 	lovewrap::initialize(L);
+	lovewrap::job::initialize();
 
 	// Preload LOVE
 	lua_getglobal(L, "package");
@@ -122,6 +125,9 @@ int runGame(int argc, char *argv[])
 		if (lua_isnumber(L, -1))
 			retval = (int)lua_tonumber(L, -1);
 	
+	lovewrap::deinitializeScenes();
+	lovewrap::job::deinitialize();
+	lovewrap::graphics::deinitializeCommands();
 	gameQuit();
 	lua_close(L);
 
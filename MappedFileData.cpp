@@ -0,0 +1,249 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <cstring>
+
+// love
+#include "common/config.h"
+#include "common/Exception.h"
+
+#ifdef LOVE_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// lovewrap
+#include "MappedFileData.h"
+
+namespace lovewrap
+{
+namespace filesystem
+{
+
+#ifdef LOVE_WINDOWS
+
+static std::wstring toWideString(const std::string &str)
+{
+	int len = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int) str.length(), nullptr, 0);
+	std::wstring out(len, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int) str.length(), &out[0], len);
+	return out;
+}
+
+typedef HANDLE FileHandle;
+
+static FileHandle openFile(const std::string &realPath)
+{
+	HANDLE file = CreateFileW(toWideString(realPath).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw love::Exception("Could not open file %s.", realPath.c_str());
+
+	return file;
+}
+
+static void closeFile(FileHandle file)
+{
+	CloseHandle(file);
+}
+
+static uint64_t getFileSize(FileHandle file, const std::string &realPath)
+{
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+		throw love::Exception("Could not get size of file %s.", realPath.c_str());
+
+	return (uint64_t) size.QuadPart;
+}
+
+static void *mapFile(FileHandle file, const std::string &realPath, uint64_t offset, size_t size)
+{
+	// Copy-on-write needs PAGE_WRITECOPY, which only needs read access to the file.
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+
+	if (mapping == nullptr)
+		throw love::Exception("Could not map file %s.", realPath.c_str());
+
+	void *ptr = MapViewOfFile(mapping, FILE_MAP_COPY, (DWORD) (offset >> 32), (DWORD) offset, size);
+	// The view keeps the mapping alive.
+	CloseHandle(mapping);
+
+	if (ptr == nullptr)
+		throw love::Exception("Could not map file %s.", realPath.c_str());
+
+	return ptr;
+}
+
+static bool isRegularFile(const std::string &realPath)
+{
+	DWORD attributes = GetFileAttributesW(toWideString(realPath).c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+}
+
+static void unmapFile(void *ptr, size_t)
+{
+	UnmapViewOfFile(ptr);
+}
+
+static uint64_t getMapAlignment()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+}
+
+#else
+
+typedef int FileHandle;
+
+static FileHandle openFile(const std::string &realPath)
+{
+	int fd = open(realPath.c_str(), O_RDONLY);
+	if (fd == -1)
+		throw love::Exception("Could not open file %s.", realPath.c_str());
+
+	return fd;
+}
+
+static void closeFile(FileHandle fd)
+{
+	close(fd);
+}
+
+static uint64_t getFileSize(FileHandle fd, const std::string &realPath)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		throw love::Exception("Could not get size of file %s.", realPath.c_str());
+
+	return (uint64_t) st.st_size;
+}
+
+static void *mapFile(FileHandle fd, const std::string &realPath, uint64_t offset, size_t size)
+{
+	// The mapping keeps the file alive after it's closed.
+	void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t) offset);
+
+	if (ptr == MAP_FAILED)
+		throw love::Exception("Could not map file %s.", realPath.c_str());
+
+	return ptr;
+}
+
+static bool isRegularFile(const std::string &realPath)
+{
+	struct stat st;
+	return stat(realPath.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static void unmapFile(void *ptr, size_t size)
+{
+	munmap(ptr, size);
+}
+
+static uint64_t getMapAlignment()
+{
+	return (uint64_t) sysconf(_SC_PAGESIZE);
+}
+
+#endif
+
+bool MappedFileData::canMap(const std::string &realPath)
+{
+	return isRegularFile(realPath);
+}
+
+MappedFileData::MappedFileData(const std::string &realPath, uint64_t offset, uint64_t size, const std::string &filename)
+: love::filesystem::FileData(0, filename)
+, mapping(nullptr)
+, mappingSize(0)
+, data(nullptr)
+, size(0)
+{
+	static const uint64_t alignment = getMapAlignment();
+	FileHandle file = openFile(realPath);
+
+	try
+	{
+		// Mapping past end of the file gives SIGBUS on access, so the size is checked against
+		// the opened file instead of trusting the caller.
+		uint64_t fileSize = getFileSize(file, realPath);
+
+		if (offset > fileSize)
+			throw love::Exception("Could not map file %s: offset is past end of the file.", realPath.c_str());
+
+		if (size == WHOLE_FILE)
+			size = fileSize - offset;
+		else if (size > fileSize - offset)
+			throw love::Exception("Could not map file %s: size is past end of the file.", realPath.c_str());
+
+		this->size = (size_t) size;
+
+		// Mapping of 0 bytes is invalid.
+		if (size > 0)
+		{
+			uint64_t alignedOffset = offset - offset % alignment;
+			size_t delta = (size_t) (offset - alignedOffset);
+
+			mappingSize = (size_t) size + delta;
+			mapping = mapFile(file, realPath, alignedOffset, mappingSize);
+			data = (char *) mapping + delta;
+		}
+	}
+	catch (...)
+	{
+		closeFile(file);
+		throw;
+	}
+
+	closeFile(file);
+}
+
+MappedFileData::~MappedFileData()
+{
+	if (mapping)
+		unmapFile(mapping, mappingSize);
+}
+
+love::filesystem::FileData *MappedFileData::clone() const
+{
+	love::filesystem::FileData *fd = new love::filesystem::FileData(size, getFilename());
+	if (size > 0)
+		memcpy(fd->getData(), data, size);
+
+	return fd;
+}
+
+void *MappedFileData::getData() const
+{
+	return data;
+}
+
+size_t MappedFileData::getSize() const
+{
+	return size;
+}
+
+} // filesystem
+} // lovewrap
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_MAPPEDFILEDATA_H
+#define LOVEWRAP_MAPPEDFILEDATA_H
+
+// STL
+#include <cstdint>
+#include <string>
+
+// LOVE
+#include "modules/filesystem/FileData.h"
+
+namespace lovewrap
+{
+namespace filesystem
+{
+
+// FileData backed by memory mapping of a file on disk, instead of a heap copy
+// of it. The mapping is copy-on-write: pages are shared with the OS file cache
+// until written to, and writes never reach the file.
+class MappedFileData: public love::filesystem::FileData
+{
+public:
+	// Size which maps from the offset to the end of the file.
+	static const uint64_t WHOLE_FILE = ~(uint64_t) 0;
+
+	/**
+	 * Maps part of a file. Throws love::Exception if the part goes past end of the file.
+	 * @param realPath Platform path to the file.
+	 * @param offset Offset of the data in the file, in bytes.
+	 * @param size Size of the data in bytes, or WHOLE_FILE.
+	 * @param filename Filename reported by getFilename, e.g. the love.filesystem path.
+	 */
+	MappedFileData(const std::string &realPath, uint64_t offset, uint64_t size, const std::string &filename);
+	virtual ~MappedFileData();
+
+	/**
+	 * Checks whether file can be mapped, i.e. it's a regular file and not e.g. inside a .love archive.
+	 * @param realPath Platform path to the file.
+	 */
+	static bool canMap(const std::string &realPath);
+
+	// Clones are regular FileData.
+	love::filesystem::FileData *clone() const override;
+	void *getData() const override;
+	size_t getSize() const override;
+
+private:
+	MappedFileData(const MappedFileData&) = delete;
+	MappedFileData &operator=(const MappedFileData&) = delete;
+
+	// Start of the mapping, which is aligned to page or allocation granularity.
+	void *mapping;
+	size_t mappingSize;
+	char *data;
+	size_t size;
+};
+
+} // filesystem
+} // lovewrap
+
+#endif
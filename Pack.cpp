@@ -0,0 +1,378 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// love
+#include "common/config.h"
+
+// lovewrap
+#include "MappedFileData.h"
+#include "Pack.h"
+
+namespace lovewrap
+{
+namespace pack
+{
+
+struct MountedPack
+{
+	std::string path;
+	std::string realPath;
+	std::string mountPoint; // Empty or ends with slash
+	int64_t modtime;
+	std::vector<TocEntry> toc;
+	std::string names;
+	// Paths of the entries including mount point, sorted for listing directories.
+	std::vector<std::string> paths;
+};
+
+// Front is searched first.
+static std::vector<std::shared_ptr<const MountedPack>> packs;
+static std::mutex packMutex;
+
+static std::string normalizePath(const std::string &path)
+{
+	size_t start = path.find_first_not_of('/');
+	return start == std::string::npos ? std::string() : path.substr(start);
+}
+
+// Packs can be bigger than 2GB.
+static bool seek(FILE *f, uint64_t offset)
+{
+#ifdef LOVE_WINDOWS
+	return _fseeki64(f, (__int64) offset, SEEK_SET) == 0;
+#else
+	return fseeko(f, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+static bool getSize(FILE *f, uint64_t &size)
+{
+#ifdef LOVE_WINDOWS
+	if (_fseeki64(f, 0, SEEK_END) != 0)
+		return false;
+
+	__int64 end = _ftelli64(f);
+#else
+	if (fseeko(f, 0, SEEK_END) != 0)
+		return false;
+
+	off_t end = ftello(f);
+#endif
+
+	if (end < 0)
+		return false;
+
+	size = (uint64_t) end;
+	return seek(f, 0);
+}
+
+// Whether range of count items of itemSize at offset fits in size, without overflow.
+static bool fits(uint64_t offset, uint64_t count, uint64_t itemSize, uint64_t size)
+{
+	return offset <= size && count <= (size - offset) / itemSize;
+}
+
+// Order of the TOC, same as tools/PackBuilder.cpp.
+static bool isBefore(const MountedPack &pack, const TocEntry &a, const TocEntry &b)
+{
+	if (a.hash != b.hash)
+		return a.hash < b.hash;
+
+	int cmp = memcmp(pack.names.data() + a.nameOffset, pack.names.data() + b.nameOffset, std::min(a.nameLength, b.nameLength));
+	return cmp != 0 ? cmp < 0 : a.nameLength < b.nameLength;
+}
+
+static void readPack(FILE *f, MountedPack &pack)
+{
+	Header header;
+	uint64_t fileSize;
+
+	if (!getSize(f, fileSize))
+		throw love::Exception("Could not read pack %s.", pack.path.c_str());
+
+	if (fread(&header, sizeof(Header), 1, f) != 1 || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+		throw love::Exception("%s is not a pack.", pack.path.c_str());
+
+	if (header.version != VERSION)
+		throw love::Exception("%s has unsupported pack version %u.", pack.path.c_str(), header.version);
+
+	// Checked before allocating, so garbage header can't cause huge allocations.
+	if (
+		header.alignment == 0 || (header.alignment & (header.alignment - 1)) != 0 ||
+		!fits(header.tocOffset, header.entryCount, sizeof(TocEntry), fileSize) ||
+		!fits(header.namesOffset, header.namesSize, 1, fileSize)
+	)
+		throw love::Exception("Pack %s is corrupted.", pack.path.c_str());
+
+	pack.toc.resize((size_t) header.entryCount);
+	pack.names.resize((size_t) header.namesSize);
+
+	if (
+		!seek(f, header.tocOffset) ||
+		fread(pack.toc.data(), sizeof(TocEntry), pack.toc.size(), f) != pack.toc.size() ||
+		!seek(f, header.namesOffset) ||
+		fread(&pack.names[0], 1, pack.names.size(), f) != pack.names.size()
+	)
+		throw love::Exception("Could not read pack %s.", pack.path.c_str());
+
+	for (size_t i = 0; i < pack.toc.size(); i++)
+	{
+		const TocEntry &e = pack.toc[i];
+
+		// Entries are memory mapped, so data past end of the pack would be SIGBUS instead of error.
+		if (
+			(uint64_t) e.nameOffset + e.nameLength > header.namesSize ||
+			!fits(e.offset, e.size, 1, fileSize) ||
+			e.offset % header.alignment != 0 ||
+			((e.flags & ENTRY_ZLIB) != 0 && e.rawSize == 0) ||
+			(i > 0 && !isBefore(pack, pack.toc[i - 1], e))
+		)
+			throw love::Exception("Pack %s is corrupted.", pack.path.c_str());
+	}
+}
+
+void mount(const std::string &path, const std::string &mountPoint)
+{
+	std::shared_ptr<MountedPack> pack = std::make_shared<MountedPack>();
+	love::filesystem::Filesystem::Info info;
+
+	if (!filesystem::getInfo(path, love::filesystem::Filesystem::FILETYPE_FILE, &info))
+		throw love::Exception("Could not open pack %s.", path.c_str());
+
+	pack->path = path;
+	pack->realPath = filesystem::getInstance()->getRealDirectory(path.c_str()) + "/" + path;
+	pack->mountPoint = normalizePath(mountPoint);
+	pack->modtime = info.modtime;
+
+	if (!pack->mountPoint.empty() && pack->mountPoint.back() != '/')
+		pack->mountPoint += '/';
+
+	// Entries are memory mapped, so the pack can't be inside an archive.
+	if (!filesystem::MappedFileData::canMap(pack->realPath))
+		throw love::Exception("Pack %s must be directly on disk.", path.c_str());
+
+	FILE *f = fopen(pack->realPath.c_str(), "rb");
+	if (f == nullptr)
+		throw love::Exception("Could not open pack %s.", path.c_str());
+
+	try
+	{
+		readPack(f, *pack);
+		fclose(f);
+	}
+	catch (love::Exception &)
+	{
+		fclose(f);
+		throw;
+	}
+
+	pack->paths.reserve(pack->toc.size());
+	for (const TocEntry &e: pack->toc)
+		pack->paths.push_back(pack->mountPoint + pack->names.substr(e.nameOffset, e.nameLength));
+
+	std::sort(pack->paths.begin(), pack->paths.end());
+
+	{
+		std::lock_guard<std::mutex> lock(packMutex);
+		packs.insert(packs.begin(), pack);
+	}
+
+	// Outside of packMutex, as the index calls into packs with its own lock held.
+	filesystem::invalidateIndex(std::string());
+}
+
+bool unmount(const std::string &path)
+{
+	bool found = false;
+
+	{
+		std::lock_guard<std::mutex> lock(packMutex);
+
+		for (auto iter = packs.begin(); iter != packs.end(); ++iter)
+		{
+			if ((*iter)->path == path)
+			{
+				packs.erase(iter);
+				found = true;
+				break;
+			}
+		}
+	}
+
+	if (found)
+		filesystem::invalidateIndex(std::string());
+
+	return found;
+}
+
+// Returns first path in pack under directory prefix, or end.
+static std::vector<std::string>::const_iterator findPrefix(const MountedPack &pack, const std::string &prefix)
+{
+	auto iter = std::lower_bound(pack.paths.begin(), pack.paths.end(), prefix);
+
+	if (iter != pack.paths.end() && iter->compare(0, prefix.length(), prefix) == 0)
+		return iter;
+
+	return pack.paths.end();
+}
+
+static std::string getDirectoryPrefix(const std::string &dir)
+{
+	std::string prefix = normalizePath(dir);
+
+	if (!prefix.empty() && prefix.back() != '/')
+		prefix += '/';
+
+	return prefix;
+}
+
+bool isDirectory(const std::string &path)
+{
+	std::string prefix = getDirectoryPrefix(path);
+	std::lock_guard<std::mutex> lock(packMutex);
+
+	for (const std::shared_ptr<const MountedPack> &pack: packs)
+	{
+		if (findPrefix(*pack, prefix) != pack->paths.end())
+			return true;
+	}
+
+	return false;
+}
+
+void getDirectoryItems(const std::string &dir, std::vector<std::string> &items)
+{
+	std::string prefix = getDirectoryPrefix(dir);
+	std::lock_guard<std::mutex> lock(packMutex);
+
+	for (const std::shared_ptr<const MountedPack> &pack: packs)
+	{
+		size_t first = items.size();
+
+		for (auto iter = findPrefix(*pack, prefix); iter != pack->paths.end() && iter->compare(0, prefix.length(), prefix) == 0; ++iter)
+		{
+			size_t end = iter->find('/', prefix.length());
+			std::string name = iter->substr(prefix.length(), end == std::string::npos ? std::string::npos : end - prefix.length());
+
+			// Files of a subdirectory are consecutive.
+			if (items.size() == first || items.back() != name)
+				items.push_back(name);
+		}
+	}
+}
+
+// Returns nullptr if not found.
+static const TocEntry *findEntry(const MountedPack &pack, const std::string &path)
+{
+	if (path.compare(0, pack.mountPoint.length(), pack.mountPoint) != 0)
+		return nullptr;
+
+	const char *name = path.c_str() + pack.mountPoint.length();
+	size_t length = path.length() - pack.mountPoint.length();
+	uint64_t hash = hashPath(name, length);
+
+	auto iter = std::lower_bound(pack.toc.begin(), pack.toc.end(), hash, [](const TocEntry &e, uint64_t h)
+	{
+		return e.hash < h;
+	});
+
+	for (; iter != pack.toc.end() && iter->hash == hash; ++iter)
+	{
+		if (iter->nameLength == length && memcmp(pack.names.data() + iter->nameOffset, name, length) == 0)
+			return &*iter;
+	}
+
+	return nullptr;
+}
+
+// Returns pack containing path, and its entry.
+static std::shared_ptr<const MountedPack> find(const std::string &path, const TocEntry *&entry)
+{
+	std::string normalized = normalizePath(path);
+	std::lock_guard<std::mutex> lock(packMutex);
+
+	for (const std::shared_ptr<const MountedPack> &pack: packs)
+	{
+		entry = findEntry(*pack, normalized);
+		if (entry)
+			return pack;
+	}
+
+	return nullptr;
+}
+
+bool exists(const std::string &path)
+{
+	return getInfo(path, nullptr);
+}
+
+bool getInfo(const std::string &path, love::filesystem::Filesystem::Info *info)
+{
+	const TocEntry *entry = nullptr;
+	std::shared_ptr<const MountedPack> pack = find(path, entry);
+
+	if (!pack)
+		return false;
+
+	if (info)
+	{
+		info->size = (int64_t) entry->rawSize;
+		info->modtime = pack->modtime;
+		info->type = love::filesystem::Filesystem::FILETYPE_FILE;
+	}
+
+	return true;
+}
+
+love::filesystem::FileData *newFileData(const std::string &path)
+{
+	const TocEntry *entry = nullptr;
+	std::shared_ptr<const MountedPack> pack = find(path, entry);
+
+	if (!pack)
+		return nullptr;
+
+	std::string filename = normalizePath(path);
+	// Compressed data doesn't need to outlive this function.
+	love::StrongRef<filesystem::MappedFileData> data(new filesystem::MappedFileData(pack->realPath, entry->offset, entry->size, filename), love::Acquire::NORETAIN);
+
+	if ((entry->flags & ENTRY_ZLIB) == 0)
+	{
+		data->retain();
+		return data;
+	}
+
+	size_t rawSize = (size_t) entry->rawSize;
+	char *bytes = love::data::decompress(love::data::Compressor::FORMAT_ZLIB, (const char *) data->getData(), data->getSize(), rawSize);
+	std::unique_ptr<char[]> owner(bytes);
+
+	return filesystem::newFileData(bytes, rawSize, filename);
+}
+
+} // pack
+} // lovewrap
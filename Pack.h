@@ -0,0 +1,87 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_PACK_H
+#define LOVEWRAP_PACK_H
+
+// STL
+#include <string>
+#include <vector>
+
+// lovewrap
+#include "LOVEWrap.h"
+#include "PackFormat.h"
+
+namespace lovewrap
+{
+
+// Asset packs built with tools/PackBuilder.cpp. Files in mounted packs are found
+// by filesystem::newFileData, filesystem::getInfo and graphics::newImage before
+// the game and save directory, and are listed by filesystem::getDirectoryItems
+// and filesystem::glob. Lookup is binary search over the table of
+// contents, and uncompressed files are memory mapped instead of read.
+namespace pack
+{
+
+/**
+ * Mounts pack. Packs mounted later are searched first.
+ * @param path Path of the pack in love.filesystem. It must be directly on disk, not inside
+ *             .love archive.
+ * @param mountPoint Directory where the pack contents appear, or empty string for the root.
+ */
+void mount(const std::string &path, const std::string &mountPoint = std::string());
+/**
+ * Unmounts pack.
+ * @param path Path of the pack, as given to mount.
+ * @return false if the pack isn't mounted.
+ */
+bool unmount(const std::string &path);
+bool exists(const std::string &path);
+/**
+ * Gets information about file in mounted packs.
+ * @param path The file path.
+ * @param info Struct to contain the file information. Can be NULL.
+ * @return true if the file is in a mounted pack.
+ */
+bool getInfo(const std::string &path, love::filesystem::Filesystem::Info *info);
+/**
+ * Creates FileData of file in mounted packs.
+ * @param path The file path.
+ * @return The FileData, or nullptr if the file isn't in a mounted pack.
+ */
+love::filesystem::FileData *newFileData(const std::string &path);
+/**
+ * Checks whether directory has files in mounted packs. Directories are implied by the paths of
+ * the files and the mount points.
+ * @param path The directory path.
+ */
+bool isDirectory(const std::string &path);
+/**
+ * Adds names of files and directories directly in directory of mounted packs. Names in more
+ * than one pack are added more than once.
+ * @param dir The directory path.
+ * @param items Vector the names are added to.
+ */
+void getDirectoryItems(const std::string &dir, std::vector<std::string> &items);
+
+} // pack
+} // lovewrap
+
+#endif
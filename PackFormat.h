@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_PACKFORMAT_H
+#define LOVEWRAP_PACKFORMAT_H
+
+// STL
+#include <cstddef>
+#include <cstdint>
+
+// Pack file layout, shared by the game and tools/PackBuilder.cpp. All values
+// are little endian.
+//
+// Header
+// Entry data, each starting at multiple of Header::alignment
+// Table of contents: Header::entryCount of TocEntry, sorted by hash then name
+// Names: TocEntry::nameLength bytes at TocEntry::nameOffset, not NUL-terminated
+namespace lovewrap
+{
+namespace pack
+{
+
+const char MAGIC[8] = {'L', 'W', 'P', 'A', 'C', 'K', '\x1A', '\n'};
+const uint32_t VERSION = 1;
+// Entry data alignment, so uncompressed entries can be memory mapped directly.
+const uint32_t ALIGNMENT = 4096;
+
+enum EntryFlags
+{
+	ENTRY_ZLIB = 1 << 0,
+};
+
+struct Header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t alignment;
+	uint64_t entryCount;
+	uint64_t tocOffset;
+	uint64_t namesOffset;
+	uint64_t namesSize;
+};
+
+struct TocEntry
+{
+	uint64_t hash;      // hashPath of the name
+	uint64_t offset;    // Offset of the data from start of the pack
+	uint64_t size;      // Size of the data in the pack
+	uint64_t rawSize;   // Size after decompression
+	uint32_t nameOffset; // Offset from Header::namesOffset
+	uint32_t nameLength;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(Header) == 48, "Pack header must be packed");
+static_assert(sizeof(TocEntry) == 48, "Pack TOC entry must be packed");
+
+/**
+ * Hashes path, as used in TocEntry::hash.
+ * @param path Path relative to the pack root, with forward slashes and no leading slash.
+ * @param length Length of the path.
+ */
+inline uint64_t hashPath(const char *path, size_t length)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < length; i++)
+		h = (h ^ (uint8_t) path[i]) * 1099511628211ULL;
+
+	return h;
+}
+
+} // pack
+} // lovewrap
+
+#endif
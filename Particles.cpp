@@ -0,0 +1,535 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+// lovewrap
+#include "Affine2D.h"
+#include "Job.h"
+#include "Particles.h"
+#include "SIMD.h"
+#include "SpriteKernel.h"
+
+namespace lovewrap
+{
+namespace particle
+{
+
+using namespace simd;
+
+// Particles per update range. Emitters smaller than this are updated in one
+// thread. Multiple of 4.
+static const size_t PARALLEL_GRAIN = 16384;
+
+static size_t padSize(size_t size)
+{
+	return (size + 3) & ~(size_t) 3;
+}
+
+Emitter::Emitter(size_t bufferSize)
+: capacity(0)
+, count(0)
+, px(0.0f)
+, py(0.0f)
+, areaW(0.0f)
+, areaH(0.0f)
+, emissionRate(0.0f)
+, emitCounter(0.0f)
+, lifetimeMin(1.0f)
+, lifetimeMax(1.0f)
+, direction(0.0f)
+, spread(0.0f)
+, speedMin(0.0f)
+, speedMax(0.0f)
+, accelX(0.0f)
+, accelY(0.0f)
+, damping(0.0f)
+, rotationMin(0.0f)
+, rotationMax(0.0f)
+, spinMin(0.0f)
+, spinMax(0.0f)
+, ox(0.0f)
+, oy(0.0f)
+, offsetSet(false)
+, active(true)
+, rngState((uint64_t) (uintptr_t) this | 1)
+, sizes(1, 1.0f)
+, colors(1, love::Colorf(1.0f, 1.0f, 1.0f, 1.0f))
+{
+	setBufferSize(bufferSize);
+	buildTables();
+}
+
+void Emitter::setBufferSize(size_t size)
+{
+	size_t padded = padSize(size);
+
+	x.resize(padded);
+	y.resize(padded);
+	vx.resize(padded);
+	vy.resize(padded);
+	rotation.resize(padded);
+	spin.resize(padded);
+	age.resize(padded);
+	invLifetime.resize(padded, 1.0f);
+	this->size.resize(padded);
+	color.resize(padded);
+
+	capacity = size;
+	count = std::min(count, size);
+}
+
+size_t Emitter::getBufferSize() const
+{
+	return capacity;
+}
+
+size_t Emitter::getCount() const
+{
+	return count;
+}
+
+void Emitter::setPosition(float x, float y)
+{
+	px = x;
+	py = y;
+}
+
+void Emitter::setEmissionArea(float w, float h)
+{
+	areaW = w;
+	areaH = h;
+}
+
+void Emitter::setEmissionRate(float rate)
+{
+	if (rate < 0.0f)
+		throw love::Exception("Invalid emission rate");
+
+	emissionRate = rate;
+}
+
+void Emitter::setParticleLifetime(float min, float max)
+{
+	if (min <= 0.0f || max < min)
+		throw love::Exception("Invalid particle lifetime");
+
+	lifetimeMin = min;
+	lifetimeMax = max;
+}
+
+void Emitter::setDirection(float direction)
+{
+	this->direction = direction;
+}
+
+void Emitter::setSpread(float spread)
+{
+	this->spread = spread;
+}
+
+void Emitter::setSpeed(float min, float max)
+{
+	speedMin = min;
+	speedMax = max;
+}
+
+void Emitter::setLinearAcceleration(float x, float y)
+{
+	accelX = x;
+	accelY = y;
+}
+
+void Emitter::setLinearDamping(float damping)
+{
+	this->damping = damping;
+}
+
+void Emitter::setRotation(float min, float max)
+{
+	rotationMin = min;
+	rotationMax = max;
+}
+
+void Emitter::setSpin(float min, float max)
+{
+	spinMin = min;
+	spinMax = max;
+}
+
+void Emitter::setSizes(const std::vector<float> &sizes)
+{
+	if (sizes.empty() || sizes.size() > 8)
+		throw love::Exception("At least one and at most 8 sizes can be used.");
+
+	this->sizes = sizes;
+	buildTables();
+}
+
+void Emitter::setColors(const std::vector<love::Colorf> &colors)
+{
+	if (colors.empty() || colors.size() > 8)
+		throw love::Exception("At least one and at most 8 colors can be used.");
+
+	this->colors = colors;
+	buildTables();
+}
+
+void Emitter::setOffset(float ox, float oy)
+{
+	this->ox = ox;
+	this->oy = oy;
+	offsetSet = true;
+}
+
+void Emitter::setSeed(uint64_t seed)
+{
+	// xorshift state can't be 0
+	rngState = seed ? seed : 1;
+}
+
+void Emitter::start()
+{
+	active = true;
+}
+
+void Emitter::stop()
+{
+	active = false;
+	emitCounter = 0.0f;
+}
+
+bool Emitter::isActive() const
+{
+	return active;
+}
+
+void Emitter::reset()
+{
+	count = 0;
+	emitCounter = 0.0f;
+}
+
+void Emitter::emit(size_t amount)
+{
+	amount = std::min(amount, capacity - count);
+
+	for (size_t i = 0; i < amount; i++)
+		spawn();
+}
+
+float Emitter::random()
+{
+	// xorshift64*
+	rngState ^= rngState >> 12;
+	rngState ^= rngState << 25;
+	rngState ^= rngState >> 27;
+	return (float) ((rngState * 2685821657736338717ULL) >> 40) * (1.0f / 16777216.0f);
+}
+
+float Emitter::random(float min, float max)
+{
+	return min + (max - min) * random();
+}
+
+void Emitter::spawn()
+{
+	size_t i = count++;
+	float lifetime = random(lifetimeMin, lifetimeMax);
+	float angle = direction + (random() - 0.5f) * spread;
+	float speed = random(speedMin, speedMax);
+
+	x[i] = px + (random() - 0.5f) * areaW;
+	y[i] = py + (random() - 0.5f) * areaH;
+	vx[i] = cosf(angle) * speed;
+	vy[i] = sinf(angle) * speed;
+	rotation[i] = random(rotationMin, rotationMax);
+	spin[i] = random(spinMin, spinMax);
+	age[i] = 0.0f;
+	invLifetime[i] = 1.0f / lifetime;
+	size[i] = sizeTable[0];
+	color[i] = colorTable[0];
+}
+
+void Emitter::remove(size_t i)
+{
+	size_t last = --count;
+
+	x[i] = x[last];
+	y[i] = y[last];
+	vx[i] = vx[last];
+	vy[i] = vy[last];
+	rotation[i] = rotation[last];
+	spin[i] = spin[last];
+	age[i] = age[last];
+	invLifetime[i] = invLifetime[last];
+	size[i] = size[last];
+	color[i] = color[last];
+}
+
+void Emitter::buildTables()
+{
+	for (int i = 0; i < TABLE_SIZE; i++)
+	{
+		float t = (float) i / (TABLE_SIZE - 1);
+
+		float s = t * (sizes.size() - 1);
+		size_t k = std::min((size_t) s, sizes.size() - 1);
+		size_t k2 = std::min(k + 1, sizes.size() - 1);
+		float f = s - k;
+		sizeTable[i] = sizes[k] + (sizes[k2] - sizes[k]) * f;
+
+		float c = t * (colors.size() - 1);
+		k = std::min((size_t) c, colors.size() - 1);
+		k2 = std::min(k + 1, colors.size() - 1);
+		f = c - k;
+		const love::Colorf &a = colors[k], &b = colors[k2];
+		colorTable[i] = love::toColor32(love::Colorf(a.r + (b.r - a.r) * f, a.g + (b.g - a.g) * f, a.b + (b.b - a.b) * f, a.a + (b.a - a.a) * f));
+	}
+}
+
+void Emitter::integrate(float dt, size_t begin, size_t end, std::vector<uint32_t> &dead)
+{
+	const float4 dt4 = set4(dt);
+	const float4 ax = set4(accelX * dt), ay = set4(accelY * dt);
+	const float4 damp = set4(1.0f / (1.0f + damping * dt));
+	const float4 one = set4(1.0f);
+	const float4 tableScale = set4((float) (TABLE_SIZE - 1));
+	const float4 half = set4(0.5f);
+
+	// Padding past end is updated too, it's never read.
+	for (size_t i = begin; i < end; i += 4)
+	{
+		float4 vx4 = mul4(add4(load4(&vx[i]), ax), damp);
+		float4 vy4 = mul4(add4(load4(&vy[i]), ay), damp);
+		float4 age4 = add4(load4(&age[i]), dt4);
+		float4 t = mul4(age4, load4(&invLifetime[i]));
+		float tableIndex[4], life[4];
+
+		store4(&vx[i], vx4);
+		store4(&vy[i], vy4);
+		store4(&x[i], add4(load4(&x[i]), mul4(vx4, dt4)));
+		store4(&y[i], add4(load4(&y[i]), mul4(vy4, dt4)));
+		store4(&rotation[i], add4(load4(&rotation[i]), mul4(load4(&spin[i]), dt4)));
+		store4(&age[i], age4);
+		store4(life, t);
+		store4(tableIndex, add4(mul4(min4(t, one), tableScale), half));
+
+		// Curves, and dead particles
+		size_t n = std::min(end - i, (size_t) 4);
+		for (size_t j = 0; j < n; j++)
+		{
+			int k = (int) tableIndex[j];
+			size[i + j] = sizeTable[k];
+			color[i + j] = colorTable[k];
+
+			if (life[j] >= 1.0f)
+				dead.push_back((uint32_t) (i + j));
+		}
+	}
+}
+
+void Emitter::update(float dt)
+{
+	if (count > 0)
+	{
+		size_t ranges = (count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+		if (deadLists.size() < ranges)
+			deadLists.resize(ranges);
+
+		for (std::vector<uint32_t> &dead: deadLists)
+			dead.clear();
+
+		job::parallelFor(count, PARALLEL_GRAIN, [this, dt](size_t begin, size_t end)
+		{
+			integrate(dt, begin, end, deadLists[begin / PARALLEL_GRAIN]);
+		});
+
+		// Highest index first, so the particle moved into the hole is always alive.
+		for (auto list = deadLists.rbegin(); list != deadLists.rend(); ++list)
+		{
+			for (auto i = list->rbegin(); i != list->rend(); ++i)
+				remove(*i);
+		}
+	}
+
+	if (active)
+	{
+		emitCounter += emissionRate * dt;
+		size_t amount = (size_t) emitCounter;
+		emitCounter -= amount;
+		emit(amount);
+	}
+}
+
+graphics::SpriteArrays Emitter::getArrays(float w, float h) const
+{
+	graphics::SpriteArrays arrays;
+	arrays.x = Span<float>(x.data(), count);
+	arrays.y = Span<float>(y.data(), count);
+	arrays.rotation = Span<float>(rotation.data(), count);
+	arrays.scaleX = Span<float>(size.data(), count);
+	arrays.color = Span<love::Color32>(color.data(), count);
+	arrays.ox = offsetSet ? ox : w * 0.5f;
+	arrays.oy = offsetSet ? oy : h * 0.5f;
+	return arrays;
+}
+
+static void getSpriteSize(graphics::Texture *texture, graphics::Quad *quad, float &w, float &h)
+{
+	if (quad)
+	{
+		love::graphics::Quad::Viewport v = quad->getViewport();
+		w = (float) v.w;
+		h = (float) v.h;
+	}
+	else
+	{
+		w = (float) texture->getWidth();
+		h = (float) texture->getHeight();
+	}
+}
+
+void Emitter::draw(graphics::Texture *texture, graphics::Quad *quad)
+{
+	float w, h;
+	getSpriteSize(texture, quad, w, h);
+
+	if (quad)
+		graphics::drawMany(texture, Span<graphics::Quad*>(&quad, 1), getArrays(w, h));
+	else
+		graphics::drawMany(texture, Span<graphics::Quad*>(), getArrays(w, h));
+}
+
+void Emitter::writeTo(graphics::SpriteBatch *batch, graphics::Quad *quad)
+{
+	float w, h;
+	getSpriteSize(batch->getTexture(), quad, w, h);
+	graphics::SpriteArrays arrays = getArrays(w, h);
+
+	batch->clear();
+	if ((size_t) batch->getBufferSize() < count)
+		batch->setBufferSize((int) count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		love::Color32 c = color[i];
+		love::Matrix4 m = makeAffine(x[i], y[i], rotation[i], size[i], size[i], arrays.ox, arrays.oy, 0.0f, 0.0f).toMatrix4();
+
+		batch->setColor(love::Colorf(c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, c.a / 255.0f));
+
+		if (quad)
+			batch->add(quad, m);
+		else
+			batch->add(m);
+	}
+
+	batch->setColor(love::Colorf(1.0f, 1.0f, 1.0f, 1.0f));
+}
+
+bool Emitter::writeTo(graphics::Mesh *mesh, graphics::Quad *quad)
+{
+	if (mesh->getVertexStride() != sizeof(sprite::Vertex) || mesh->getDrawMode() != graphics::PRIMITIVE_TRIANGLES)
+		throw love::Exception("Mesh must be created by particle::newMesh.");
+	if (mesh->getVertexCount() < count * 4)
+		throw love::Exception("Mesh can hold %d particles, but there are %d.", (int) (mesh->getVertexCount() / 4), (int) count);
+
+	// Empty draw range is invalid.
+	if (count == 0)
+		return false;
+
+	float w = (float) quad->getViewport().w, h = (float) quad->getViewport().h;
+	sprite::QuadInfo info = sprite::getQuadInfo(quad);
+	auto out = (sprite::Vertex *) mesh->mapVertexData();
+
+	sprite::generateVertices(Affine2D(), love::Colorf(1.0f, 1.0f, 1.0f, 1.0f), getArrays(w, h), 0, count, &info, 1, out);
+	mesh->unmapVertexData(0, count * 4 * sizeof(sprite::Vertex));
+	mesh->setDrawRange(0, (int) count * 6);
+	return true;
+}
+
+const float *Emitter::getX() const
+{
+	return x.data();
+}
+
+const float *Emitter::getY() const
+{
+	return y.data();
+}
+
+const float *Emitter::getRotation() const
+{
+	return rotation.data();
+}
+
+const float *Emitter::getSize() const
+{
+	return size.data();
+}
+
+const love::Color32 *Emitter::getColor() const
+{
+	return color.data();
+}
+
+void update(Span<Emitter*> emitters, float dt)
+{
+	size_t total = 0;
+	for (Emitter *e: emitters)
+		total += e->getCount();
+
+	// Large emitters split their own update.
+	if (emitters.size <= 1 || total / emitters.size >= PARALLEL_GRAIN)
+	{
+		for (Emitter *e: emitters)
+			e->update(dt);
+
+		return;
+	}
+
+	job::parallelFor(emitters.size, 1, [&emitters, dt](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			emitters[i]->update(dt);
+	});
+}
+
+graphics::Mesh *newMesh(size_t bufferSize, graphics::Texture *texture)
+{
+	// Two triangles per particle, in the vertex order of sprite::generateVertices.
+	std::vector<uint32_t> map(bufferSize * 6);
+	for (size_t i = 0; i < bufferSize; i++)
+	{
+		uint32_t v = (uint32_t) i * 4;
+		uint32_t quad[6] = {v, v + 1, v + 2, v + 2, v + 1, v + 3};
+		std::copy(quad, quad + 6, &map[i * 6]);
+	}
+
+	graphics::Mesh *mesh = graphics::newMesh(graphics::Mesh::getDefaultVertexFormat(), (int) bufferSize * 4, graphics::PRIMITIVE_TRIANGLES, graphics::vertex::USAGE_STREAM);
+	mesh->setVertexMap(map);
+	mesh->setTexture(texture);
+	return mesh;
+}
+
+} // particle
+} // lovewrap
@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_PARTICLES_H
+#define LOVEWRAP_PARTICLES_H
+
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// lovewrap
+#include "LOVEWrap.h"
+
+namespace lovewrap
+{
+
+// Particle engine. Particles are stored as structure of arrays and updated 4
+// at a time with SSE2 or NEON when available. Large emitters split their
+// update across worker threads.
+namespace particle
+{
+
+class Emitter
+{
+public:
+	/**
+	 * @param bufferSize Maximum amount of particles.
+	 */
+	Emitter(size_t bufferSize = 1000);
+
+	/**
+	 * Sets maximum amount of particles. Particles past the new size are removed.
+	 * @param size Amount of particles.
+	 */
+	void setBufferSize(size_t size);
+	size_t getBufferSize() const;
+	// Amount of live particles.
+	size_t getCount() const;
+
+	void setPosition(float x, float y);
+	/**
+	 * Sets size of the area particles are spawned in, centered on the position.
+	 * @param w Width of the area.
+	 * @param h Height of the area.
+	 */
+	void setEmissionArea(float w, float h);
+	/**
+	 * Sets amount of particles emitted per second while active.
+	 * @param rate Particles per second.
+	 */
+	void setEmissionRate(float rate);
+	void setParticleLifetime(float min, float max);
+	// Direction in radians, spread is the full angle particles are emitted in.
+	void setDirection(float direction);
+	void setSpread(float spread);
+	void setSpeed(float min, float max);
+	void setLinearAcceleration(float x, float y);
+	/**
+	 * Sets how fast particles slow down. Velocity is divided by (1 + damping * dt) each update.
+	 * @param damping Amount of damping.
+	 */
+	void setLinearDamping(float damping);
+	// Initial rotation and rotation speed, in radians.
+	void setRotation(float min, float max);
+	void setSpin(float min, float max);
+	/**
+	 * Sets sizes over particle lifetime, evenly spaced and linearly interpolated. Defaults to 1.
+	 * @param sizes Up to 8 sizes.
+	 */
+	void setSizes(const std::vector<float> &sizes);
+	/**
+	 * Sets colors over particle lifetime, evenly spaced and linearly interpolated.
+	 * Defaults to white.
+	 * @param colors Up to 8 colors.
+	 */
+	void setColors(const std::vector<love::Colorf> &colors);
+	/**
+	 * Sets origin of the particle sprites. Defaults to center of the texture or quad.
+	 */
+	void setOffset(float ox, float oy);
+	void setSeed(uint64_t seed);
+
+	void start();
+	void stop();
+	bool isActive() const;
+	// Removes all particles.
+	void reset();
+	/**
+	 * Spawns particles immediately, up to the buffer size.
+	 * @param count Amount of particles.
+	 */
+	void emit(size_t count);
+	/**
+	 * Moves particles, removes dead ones and emits new ones.
+	 * @param dt Delta time, in seconds.
+	 */
+	void update(float dt);
+
+	/**
+	 * Draws the particles with graphics::drawMany.
+	 * @param texture The particle texture.
+	 * @param quad Region of the texture, or nullptr for whole texture.
+	 */
+	void draw(graphics::Texture *texture, graphics::Quad *quad = nullptr);
+	/**
+	 * Replaces contents of the SpriteBatch with the particles. The buffer of the SpriteBatch is
+	 * grown when needed.
+	 * @param batch The SpriteBatch, from graphics::newSpriteBatch.
+	 * @param quad Region of the texture, or nullptr for whole texture.
+	 */
+	void writeTo(graphics::SpriteBatch *batch, graphics::Quad *quad = nullptr);
+	/**
+	 * Writes the particles to Mesh created by particle::newMesh, and sets its draw range.
+	 * @param mesh The Mesh. Throws love::Exception if it can't hold the particles.
+	 * @param quad Region of the mesh texture.
+	 * @return false if there are no particles, in which case the mesh is left as is and
+	 *         shouldn't be drawn.
+	 */
+	bool writeTo(graphics::Mesh *mesh, graphics::Quad *quad);
+
+	// Particle data, valid for getCount() particles until the next update.
+	const float *getX() const;
+	const float *getY() const;
+	const float *getRotation() const;
+	const float *getSize() const;
+	const love::Color32 *getColor() const;
+
+private:
+	// Sizes and colors are sampled from tables over lifetime.
+	static const int TABLE_SIZE = 256;
+
+	float random();
+	float random(float min, float max);
+	void spawn();
+	void remove(size_t i);
+	void integrate(float dt, size_t begin, size_t end, std::vector<uint32_t> &dead);
+	void buildTables();
+	graphics::SpriteArrays getArrays(float w, float h) const;
+
+	size_t capacity;
+	size_t count;
+
+	// Particles. Arrays are padded to multiple of 4.
+	std::vector<float> x, y, vx, vy;
+	std::vector<float> rotation, spin;
+	std::vector<float> age, invLifetime;
+	std::vector<float> size;
+	std::vector<love::Color32> color;
+
+	// Dead particles found by each update range.
+	std::vector<std::vector<uint32_t>> deadLists;
+
+	float px, py;
+	float areaW, areaH;
+	float emissionRate;
+	float emitCounter;
+	float lifetimeMin, lifetimeMax;
+	float direction, spread;
+	float speedMin, speedMax;
+	float accelX, accelY;
+	float damping;
+	float rotationMin, rotationMax;
+	float spinMin, spinMax;
+	float ox, oy;
+	bool offsetSet;
+	bool active;
+	uint64_t rngState;
+
+	std::vector<float> sizes;
+	std::vector<love::Colorf> colors;
+	float sizeTable[TABLE_SIZE];
+	love::Color32 colorTable[TABLE_SIZE];
+};
+
+/**
+ * Updates many emitters, spreading them across worker threads. Emitters must be distinct.
+ * @param emitters The emitters.
+ * @param dt Delta time, in seconds.
+ */
+void update(Span<Emitter*> emitters, float dt);
+/**
+ * Creates streaming Mesh for Emitter::writeTo.
+ * @param bufferSize Maximum amount of particles.
+ * @param texture The particle texture.
+ * @return Mesh with 4 vertices per particle.
+ */
+graphics::Mesh *newMesh(size_t bufferSize, graphics::Texture *texture);
+
+} // particle
+} // lovewrap
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <map>
+
+// lovewrap
+#include "LOVEWrap.h"
+#include "Profiler.h"
+
+namespace lovewrap
+{
+namespace profiler
+{
+
+static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be power of 2");
+
+// Each slot is guarded by sequence number: odd while being written, and
+// 2 * (index + 1) once event of that index is complete. Readers check the
+// sequence before and after copying so writers never have to wait.
+struct Slot
+{
+	std::atomic<uint64_t> sequence;
+	std::atomic<const char*> name;
+	std::atomic<double> start;
+	std::atomic<double> duration;
+	std::atomic<uint32_t> thread;
+};
+
+static Slot ringBuffer[CAPACITY];
+static std::atomic<uint64_t> head(0);
+static std::atomic<bool> enabled(false);
+static std::atomic<uint32_t> threadCounter(0);
+
+static uint32_t getThreadID()
+{
+	static thread_local uint32_t id = threadCounter.fetch_add(1, std::memory_order_relaxed);
+	return id;
+}
+
+void setEnabled(bool enable)
+{
+	enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool isEnabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void record(const char *name, double start, double end)
+{
+	if (!isEnabled())
+		return;
+
+	uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+	Slot &slot = ringBuffer[index & (CAPACITY - 1)];
+
+	slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.start.store(start, std::memory_order_relaxed);
+	slot.duration.store(end - start, std::memory_order_relaxed);
+	slot.thread.store(getThreadID(), std::memory_order_relaxed);
+	slot.sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+std::vector<Event> getEvents()
+{
+	std::vector<Event> events;
+	uint64_t end = head.load(std::memory_order_acquire);
+	uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+	events.reserve((size_t) (end - begin));
+
+	for (uint64_t i = begin; i < end; i++)
+	{
+		const Slot &slot = ringBuffer[i & (CAPACITY - 1)];
+		uint64_t expected = i * 2 + 2;
+
+		if (slot.sequence.load(std::memory_order_acquire) != expected)
+			continue;
+
+		Event e;
+		e.name = slot.name.load(std::memory_order_relaxed);
+		e.start = slot.start.load(std::memory_order_relaxed);
+		e.duration = slot.duration.load(std::memory_order_relaxed);
+		e.thread = slot.thread.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != expected || e.name == nullptr)
+			continue;
+
+		events.push_back(e);
+	}
+
+	return events;
+}
+
+static void appendJSONString(std::string &out, const char *str)
+{
+	out += '"';
+
+	for (; *str; str++)
+	{
+		char c = *str;
+
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char) c < 0x20)
+			out += ' ';
+		else
+			out += c;
+	}
+
+	out += '"';
+}
+
+std::string dumpChromeTrace()
+{
+	std::vector<Event> events = getEvents();
+	std::string out = "{\"traceEvents\":[";
+	char buf[128];
+	double base = events.empty() ? 0.0 : events[0].start;
+
+	// Enclosing scopes are recorded after the scopes inside them.
+	for (const Event &e: events)
+		base = std::min(base, e.start);
+
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const Event &e = events[i];
+
+		if (i > 0)
+			out += ",\n";
+
+		out += "{\"name\":";
+		appendJSONString(out, e.name);
+		snprintf(buf, sizeof(buf), ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			e.thread, (e.start - base) * 1000000.0, e.duration * 1000000.0
+		);
+		out += buf;
+	}
+
+	out += "],\"displayTimeUnit\":\"ms\"}";
+	return out;
+}
+
+std::vector<Summary> summarize()
+{
+	std::vector<Event> events = getEvents();
+	// Same name can be different pointer across translation units.
+	std::map<std::string, std::vector<double>> durations;
+	std::vector<Summary> result;
+
+	for (const Event &e: events)
+		durations[e.name].push_back(e.duration);
+
+	for (auto &kv: durations)
+	{
+		std::vector<double> &d = kv.second;
+		std::sort(d.begin(), d.end());
+
+		Summary s;
+		double total = 0.0;
+		for (double v: d)
+			total += v;
+
+		size_t p99 = (size_t) std::ceil(d.size() * 0.99);
+		s.name = kv.first;
+		s.count = d.size();
+		s.min = d.front();
+		s.max = d.back();
+		s.avg = total / d.size();
+		s.p99 = d[std::max<size_t>(p99, 1) - 1];
+		result.push_back(s);
+	}
+
+	return result;
+}
+
+std::string dumpSummary()
+{
+	std::vector<Summary> summaries = summarize();
+	std::string out;
+	char buf[256];
+
+	snprintf(buf, sizeof(buf), "%-24s %8s %10s %10s %10s %10s\n", "name", "count", "min", "avg", "p99", "max");
+	out += buf;
+
+	for (const Summary &s: summaries)
+	{
+		snprintf(buf, sizeof(buf), "%-24s %8u %10.3f %10.3f %10.3f %10.3f\n",
+			s.name.c_str(), (uint32_t) s.count,
+			s.min * 1000.0, s.avg * 1000.0, s.p99 * 1000.0, s.max * 1000.0
+		);
+		out += buf;
+	}
+
+	return out;
+}
+
+void clear()
+{
+	// Sequence 0 never matches any event index.
+	for (size_t i = 0; i < CAPACITY; i++)
+		ringBuffer[i].sequence.store(0, std::memory_order_release);
+}
+
+Scope::Scope(const char *name)
+: name(name)
+, start(0.0)
+, active(isEnabled())
+{
+	if (active)
+		start = timer::getTime();
+}
+
+Scope::~Scope()
+{
+	if (active)
+		record(name, start, timer::getTime());
+}
+
+} // profiler
+} // lovewrap
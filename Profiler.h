@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_PROFILER_H
+#define LOVEWRAP_PROFILER_H
+
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lovewrap
+{
+namespace profiler
+{
+
+// Amount of events kept. Older events are overwritten.
+const size_t CAPACITY = 65536;
+
+struct Event
+{
+	const char *name;
+	double start;    // In seconds, same time base as timer::getTime
+	double duration; // In seconds
+	uint32_t thread;
+};
+
+struct Summary
+{
+	std::string name;
+	size_t count;
+	double min; // In seconds
+	double avg;
+	double p99;
+	double max;
+};
+
+/**
+ * Enables or disables recording. Disabled by default.
+ * @param enable Whether to record events.
+ */
+void setEnabled(bool enable);
+bool isEnabled();
+/**
+ * Records event to the ring buffer. Can be called from any thread.
+ * @param name Event name. The pointer is stored as-is, so it must outlive the profiler
+ *             (string literals are fine).
+ * @param start Start time, as returned by timer::getTime.
+ * @param end End time, as returned by timer::getTime.
+ */
+void record(const char *name, double start, double end);
+/**
+ * Gets copy of events currently in the ring buffer, oldest first.
+ * Events which are being overwritten while copying are skipped.
+ */
+std::vector<Event> getEvents();
+/**
+ * Creates Chrome trace event format JSON (for chrome://tracing) of events in the ring buffer.
+ */
+std::string dumpChromeTrace();
+/**
+ * Computes min/avg/p99/max duration of events in the ring buffer, grouped by name.
+ */
+std::vector<Summary> summarize();
+/**
+ * Formats summarize() result as human-readable table, in milliseconds.
+ */
+std::string dumpSummary();
+void clear();
+
+// Records its own lifetime as an event.
+class Scope
+{
+public:
+	Scope(const char *name);
+	~Scope();
+
+	Scope(const Scope&) = delete;
+	Scope &operator=(const Scope&) = delete;
+
+private:
+	const char *name;
+	double start;
+	bool active;
+};
+
+} // profiler
+} // lovewrap
+
+#define LOVEWRAP_PROFILE_CONCAT2(a, b) a##b
+#define LOVEWRAP_PROFILE_CONCAT(a, b) LOVEWRAP_PROFILE_CONCAT2(a, b)
+#define LOVEWRAP_PROFILE_SCOPE(name) lovewrap::profiler::Scope LOVEWRAP_PROFILE_CONCAT(profileScope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// love
+#include "common/pixelformat.h"
+
+// lovewrap
+#include "ResourceCache.h"
+
+namespace lovewrap
+{
+namespace cache
+{
+
+struct Entry
+{
+	std::string key;
+	love::StrongRef<love::Object> object;
+	size_t bytes;
+};
+
+// Front is most recently used.
+static std::list<Entry> entries;
+static std::unordered_map<std::string, std::list<Entry>::iterator> entryMap;
+static std::recursive_mutex cacheMutex;
+static size_t totalBytes = 0;
+static size_t budget = 256 * 1024 * 1024;
+static Stats stats = {0, 0, 0, 0, 0, 0};
+
+static uint64_t hashString(const std::string &str, uint64_t h = 14695981039346656037ULL)
+{
+	for (char c: str)
+		h = (h ^ (uint8_t) c) * 1099511628211ULL;
+
+	return h;
+}
+
+static size_t estimateImageSize(love::graphics::Image *image)
+{
+	size_t size = 0;
+	love::PixelFormat format = image->getPixelFormat();
+	bool compressed = love::isPixelFormatCompressed(format);
+
+	for (int i = 0; i < image->getMipmapCount(); i++)
+	{
+		size_t pixels = (size_t) image->getPixelWidth(i) * (size_t) image->getPixelHeight(i);
+		// Compressed formats are between 4 and 8 bits per pixel.
+		size += compressed ? pixels : pixels * love::getPixelFormatSize(format);
+	}
+
+	return size;
+}
+
+static size_t estimateFontSize(int size)
+{
+	// Glyph texture of printable ASCII in 2-byte pixel format.
+	return (size_t) size * (size_t) size * 96 * 2;
+}
+
+// Must be called with cacheMutex locked.
+static love::Object *find(const std::string &key)
+{
+	auto iter = entryMap.find(key);
+	if (iter == entryMap.end())
+	{
+		stats.misses++;
+		return nullptr;
+	}
+
+	stats.hits++;
+	entries.splice(entries.begin(), entries, iter->second);
+	return iter->second->object.get();
+}
+
+// Must be called with cacheMutex locked.
+static std::list<Entry>::iterator remove(std::list<Entry>::iterator iter)
+{
+	totalBytes -= iter->bytes;
+	stats.evictions++;
+	entryMap.erase(iter->key);
+	return entries.erase(iter);
+}
+
+// Must be called with cacheMutex locked.
+static void evict(size_t target)
+{
+	auto iter = entries.end();
+
+	while (totalBytes > target && iter != entries.begin())
+	{
+		--iter;
+
+		// Only the cache has it
+		if (iter->object->getReferenceCount() == 1)
+			iter = remove(iter);
+	}
+}
+
+// Must be called with cacheMutex locked.
+static void insert(const std::string &key, love::Object *object, size_t bytes)
+{
+	Entry e;
+	e.key = key;
+	e.object.set(object);
+	e.bytes = bytes;
+
+	entries.push_front(e);
+	entryMap[key] = entries.begin();
+	totalBytes += bytes;
+	evict(budget);
+}
+
+love::graphics::Image *getImage(const std::string &filename, const love::graphics::Image::Settings *settings)
+{
+	char buf[64];
+	std::string key = "image:" + filename;
+
+	if (settings)
+	{
+		snprintf(buf, sizeof(buf), ":%d:%d:%g", (int) settings->mipmaps, (int) settings->linear, settings->dpiScale);
+		key += buf;
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	auto image = static_cast<love::graphics::Image*>(find(key));
+
+	if (image == nullptr)
+	{
+		image = graphics::newImage(filename, settings);
+		if (image == nullptr)
+			return nullptr;
+
+		insert(key, image, estimateImageSize(image));
+	}
+	else
+		image->retain();
+
+	return image;
+}
+
+love::graphics::Font *getFont(const std::string &filename, int size)
+{
+	std::string key = "font:" + filename + ":" + std::to_string(size);
+
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	auto font = static_cast<love::graphics::Font*>(find(key));
+
+	if (font == nullptr)
+	{
+		font = graphics::newFont(filename, size);
+		insert(key, font, estimateFontSize(size));
+	}
+	else
+		font->retain();
+
+	return font;
+}
+
+static love::graphics::Shader *findShader(const std::string &vertex, const std::string &pixel, bool single)
+{
+	char buf[64];
+	uint64_t h = hashString(pixel, hashString(vertex));
+	snprintf(buf, sizeof(buf), "shader:%d:%016llx:%u:%u", (int) single, (unsigned long long) h, (uint32_t) vertex.length(), (uint32_t) pixel.length());
+	std::string key = buf;
+
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	auto shader = static_cast<love::graphics::Shader*>(find(key));
+
+	if (shader == nullptr)
+	{
+		shader = single ? graphics::newShader(vertex) : graphics::newShader(vertex, pixel);
+		// Compiled program size isn't known, use source size.
+		insert(key, shader, vertex.length() + pixel.length());
+	}
+	else
+		shader->retain();
+
+	return shader;
+}
+
+love::graphics::Shader *getShader(const std::string &code)
+{
+	return findShader(code, std::string(), true);
+}
+
+love::graphics::Shader *getShader(const std::string &vertex, const std::string &pixel)
+{
+	return findShader(vertex, pixel, false);
+}
+
+void setBudget(size_t bytes)
+{
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	budget = bytes;
+	evict(budget);
+}
+
+size_t getBudget()
+{
+	return budget;
+}
+
+void trim()
+{
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	evict(budget);
+}
+
+void clear()
+{
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+
+	for (auto iter = entries.begin(); iter != entries.end();)
+	{
+		if (iter->object->getReferenceCount() == 1)
+			iter = remove(iter);
+		else
+			++iter;
+	}
+}
+
+Stats getStats()
+{
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	Stats s = stats;
+	s.entries = entries.size();
+	s.bytes = totalBytes;
+	s.budget = budget;
+	return s;
+}
+
+void resetStats()
+{
+	std::lock_guard<std::recursive_mutex> lock(cacheMutex);
+	stats.hits = stats.misses = stats.evictions = 0;
+}
+
+} // cache
+} // lovewrap
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_RESOURCECACHE_H
+#define LOVEWRAP_RESOURCECACHE_H
+
+// STL
+#include <cstddef>
+#include <string>
+
+// lovewrap
+#include "LOVEWrap.h"
+
+namespace lovewrap
+{
+
+// Shared Image, Font and Shader objects, so the same file isn't loaded twice.
+// Objects are kept after they're no longer used, until the cache goes over its
+// memory budget. Then least recently used objects which are only referenced by
+// the cache are released.
+namespace cache
+{
+
+struct Stats
+{
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+	size_t entries;
+	size_t bytes;  // Estimated size of all cached objects
+	size_t budget;
+};
+
+/**
+ * Gets Image from cache, or loads it with graphics::newImage. Keyed by filename and settings.
+ * Like graphics::newImage, the Image is retained for the caller, so release it when it's
+ * no longer used.
+ * @param filename The filepath to the image file.
+ * @param settings Image settings.
+ * @return The Image.
+ */
+love::graphics::Image *getImage(const std::string &filename, const love::graphics::Image::Settings *settings = nullptr);
+/**
+ * Gets Font from cache, or loads it with graphics::newFont. Keyed by filename and size.
+ * The Font is retained for the caller.
+ */
+love::graphics::Font *getFont(const std::string &filename, int size = 12);
+/**
+ * Gets Shader from cache, or creates it with graphics::newShader. Keyed by hash of the code.
+ * The Shader is retained for the caller.
+ */
+love::graphics::Shader *getShader(const std::string &code);
+love::graphics::Shader *getShader(const std::string &vertex, const std::string &pixel);
+
+/**
+ * Sets memory budget. Unused objects are released, least recently used first, while the
+ * estimated size of the cache is over budget.
+ * @param bytes Budget in bytes.
+ */
+void setBudget(size_t bytes);
+size_t getBudget();
+/**
+ * Releases unused objects until the cache is within budget.
+ */
+void trim();
+/**
+ * Releases all unused objects.
+ */
+void clear();
+Stats getStats();
+void resetStats();
+
+} // cache
+} // lovewrap
+
+#endif
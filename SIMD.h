@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_SIMD_H
+#define LOVEWRAP_SIMD_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LOVEWRAP_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LOVEWRAP_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace lovewrap
+{
+
+// 4-wide float vector, with SSE2 or NEON when available. Only internal to
+// lovewrap, used by the bulk sprite and particle code.
+namespace simd
+{
+
+#if defined(LOVEWRAP_SIMD_SSE2)
+
+typedef __m128 float4;
+inline float4 load4(const float *p) { return _mm_loadu_ps(p); }
+inline float4 set4(float f) { return _mm_set1_ps(f); }
+inline void store4(float *p, float4 a) { _mm_storeu_ps(p, a); }
+inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 min4(float4 a, float4 b) { return _mm_min_ps(a, b); }
+inline float4 max4(float4 a, float4 b) { return _mm_max_ps(a, b); }
+
+inline const char *getName()
+{
+	return "SSE2";
+}
+
+#elif defined(LOVEWRAP_SIMD_NEON)
+
+typedef float32x4_t float4;
+inline float4 load4(const float *p) { return vld1q_f32(p); }
+inline float4 set4(float f) { return vdupq_n_f32(f); }
+inline void store4(float *p, float4 a) { vst1q_f32(p, a); }
+inline float4 add4(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub4(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul4(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline float4 min4(float4 a, float4 b) { return vminq_f32(a, b); }
+inline float4 max4(float4 a, float4 b) { return vmaxq_f32(a, b); }
+
+inline const char *getName()
+{
+	return "NEON";
+}
+
+#else
+
+struct float4
+{
+	float v[4];
+};
+
+inline float4 load4(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline float4 set4(float f) { return {{f, f, f, f}}; }
+inline void store4(float *p, float4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+inline float4 add4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline float4 sub4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline float4 mul4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline float4 min4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+inline float4 max4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+
+inline const char *getName()
+{
+	return "scalar";
+}
+
+#endif
+
+} // simd
+} // lovewrap
+
+#endif
@@ -19,7 +19,13 @@
  */
 
 // STL
-#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
 #include <string>
 #include <vector>
 
@@ -31,11 +37,46 @@ extern "C" {
 
 // lovewrap
 #include "LOVEWrap.h"
+#include "Profiler.h"
 #include "Scene.h"
 
-// Current scene
+// Current scene, which is the top of the scene stack
 lovewrap::Scene *currentScene = nullptr;
 
+// Scene stack
+struct SceneTransition
+{
+	enum Type
+	{
+		PUSH,
+		POP,
+		REPLACE
+	} type;
+	lovewrap::Scene *scene;
+	std::future<void> loading;
+};
+
+static std::vector<lovewrap::Scene*> sceneStack;
+static std::deque<SceneTransition> sceneTransitions;
+static std::vector<std::string> sceneArgs;
+
+// Garbage collection
+static lovewrap::GCMode gcMode = lovewrap::GC_FULL;
+static double gcMinBudget = 0.0005;
+static double gcMaxBudget = 0.002;
+static double gcFrameTarget = 0.0;
+static double gcAutoFrameTarget = -1.0;
+static bool gcFrameTargetDirty = true;
+static lovewrap::GCStats gcStats = {0.0, 0, 0, false};
+static double frameStartTime = 0.0;
+
+// Update scheduling
+static double fixedUpdateStep = 0.0;
+static int fixedUpdateMaxSteps = 5;
+static double updateAccumulator = 0.0;
+static double renderStep = 0.0;
+static double nextRenderTime = 0.0;
+
 static int loveLoad(lua_State *L)
 {
 	// args
@@ -153,6 +194,23 @@ template<typename T> inline T getConstantFromVariant(
 		throw love::Exception("index %u invalid constant value '%s'", (uint32_t) index, str.c_str());
 }
 
+static void loveEventFocus(const std::vector<love::Variant> &arg)
+{
+	currentScene->focus(getBooleanFromVariant(arg, 1));
+}
+
+static void loveEventVisible(const std::vector<love::Variant> &arg)
+{
+	currentScene->visible(getBooleanFromVariant(arg, 1));
+}
+
+static void loveEventResize(const std::vector<love::Variant> &arg)
+{
+	// Mode change may change refresh rate too
+	gcFrameTargetDirty = true;
+	currentScene->resize((int) getIntegerFromVariant(arg, 1), (int) getIntegerFromVariant(arg, 2));
+}
+
 static void loveEventKeyPressed(const std::vector<love::Variant> &arg)
 {
 	using namespace love::keyboard;
@@ -174,22 +232,393 @@ static void loveEventKeyReleased(const std::vector<love::Variant> &arg)
 	);
 }
 
-static int loveGameLoop(lua_State *L)
+static void loveEventTextInput(const std::vector<love::Variant> &arg)
+{
+	currentScene->textInput(getStringFromVariant(arg, 1));
+}
+
+static void loveEventMousePressed(const std::vector<love::Variant> &arg)
+{
+	currentScene->mousePressed(
+		(int) getIntegerFromVariant(arg, 1),
+		(int) getIntegerFromVariant(arg, 2),
+		(int) getIntegerFromVariant(arg, 3),
+		getBooleanFromVariant(arg, 4)
+	);
+}
+
+static void loveEventMouseReleased(const std::vector<love::Variant> &arg)
+{
+	currentScene->mouseReleased(
+		(int) getIntegerFromVariant(arg, 1),
+		(int) getIntegerFromVariant(arg, 2),
+		(int) getIntegerFromVariant(arg, 3),
+		getBooleanFromVariant(arg, 4)
+	);
+}
+
+static void loveEventMouseMoved(const std::vector<love::Variant> &arg)
+{
+	currentScene->mouseMoved(
+		(int) getIntegerFromVariant(arg, 1),
+		(int) getIntegerFromVariant(arg, 2),
+		(int) getIntegerFromVariant(arg, 3),
+		(int) getIntegerFromVariant(arg, 4),
+		getBooleanFromVariant(arg, 5)
+	);
+}
+
+static void loveEventMouseFocus(const std::vector<love::Variant> &arg)
+{
+	currentScene->mouseFocus(getBooleanFromVariant(arg, 1));
+}
+
+// Dense event index. EVENT_IGNORE is for events LOVE sends that Scene has no
+// virtual for, so they're dropped silently.
+enum EventType
+{
+	EVENT_QUIT,
+	EVENT_FOCUS,
+	EVENT_VISIBLE,
+	EVENT_RESIZE,
+	EVENT_KEYPRESSED,
+	EVENT_KEYRELEASED,
+	EVENT_TEXTINPUT,
+	EVENT_MOUSEPRESSED,
+	EVENT_MOUSERELEASED,
+	EVENT_MOUSEMOVED,
+	EVENT_MOUSEFOCUS,
+	EVENT_IGNORE,
+	EVENT_MAX_ENUM
+};
+
+static const EventHandlerFunc eventHandler[EVENT_MAX_ENUM] = {
+	nullptr, // quit is handled by the game loop itself
+	&loveEventFocus,
+	&loveEventVisible,
+	&loveEventResize,
+	&loveEventKeyPressed,
+	&loveEventKeyReleased,
+	&loveEventTextInput,
+	&loveEventMousePressed,
+	&loveEventMouseReleased,
+	&loveEventMouseMoved,
+	&loveEventMouseFocus,
+	nullptr,
+};
+
+static const struct
 {
-	static bool eventHandlerInitialized = false;
-	static std::map<std::string, EventHandlerFunc> eventHandler;
+	const char *name;
+	EventType type;
+} eventNames[] = {
+	{"quit", EVENT_QUIT},
+	{"focus", EVENT_FOCUS},
+	{"visible", EVENT_VISIBLE},
+	{"resize", EVENT_RESIZE},
+	{"keypressed", EVENT_KEYPRESSED},
+	{"keyreleased", EVENT_KEYRELEASED},
+	{"textinput", EVENT_TEXTINPUT},
+	{"mousepressed", EVENT_MOUSEPRESSED},
+	{"mousereleased", EVENT_MOUSERELEASED},
+	{"mousemoved", EVENT_MOUSEMOVED},
+	{"mousefocus", EVENT_MOUSEFOCUS},
+	{"textedited", EVENT_IGNORE},
+	{"wheelmoved", EVENT_IGNORE},
+	{"touchpressed", EVENT_IGNORE},
+	{"touchreleased", EVENT_IGNORE},
+	{"touchmoved", EVENT_IGNORE},
+	{"joystickadded", EVENT_IGNORE},
+	{"joystickremoved", EVENT_IGNORE},
+	{"joystickpressed", EVENT_IGNORE},
+	{"joystickreleased", EVENT_IGNORE},
+	{"joystickaxis", EVENT_IGNORE},
+	{"joystickhat", EVENT_IGNORE},
+	{"gamepadpressed", EVENT_IGNORE},
+	{"gamepadreleased", EVENT_IGNORE},
+	{"gamepadaxis", EVENT_IGNORE},
+	{"filedropped", EVENT_IGNORE},
+	{"directorydropped", EVENT_IGNORE},
+	{"lowmemory", EVENT_IGNORE},
+	{"displayrotated", EVENT_IGNORE},
+};
+
+// Maps event name to EventType using perfect hash which is computed once.
+// Lookup is single FNV-1a pass over the name and one table probe. The full
+// 32-bit hash is kept in the slot to reject names not in eventNames.
+class EventDispatcher
+{
+public:
+	EventDispatcher()
+	: multiplier(0x9E3779B1u)
+	{
+		const size_t nameCount = sizeof(eventNames) / sizeof(eventNames[0]);
+		static_assert(sizeof(eventNames) / sizeof(eventNames[0]) <= TABLE_SIZE / 2, "event table too small");
+
+		// Find multiplier which gives no collision. With the table at most
+		// half full, this takes few tries.
+		for (;;)
+		{
+			bool collision = false;
+			std::fill(slots, slots + TABLE_SIZE, Slot {0, EVENT_MAX_ENUM});
+
+			for (size_t i = 0; i < nameCount; i++)
+			{
+				uint32_t h = hash(eventNames[i].name, strlen(eventNames[i].name));
+				Slot &slot = slots[index(h)];
+
+				if (slot.type != EVENT_MAX_ENUM)
+				{
+					collision = true;
+					break;
+				}
+
+				slot.hash = h;
+				slot.type = eventNames[i].type;
+			}
+
+			if (!collision)
+				break;
+
+			// Next odd multiplier
+			multiplier = multiplier * 1664525u + 1013904223u;
+			multiplier |= 1u;
+		}
+	}
+
+	EventType find(const std::string &name) const
+	{
+		uint32_t h = hash(name.c_str(), name.length());
+		const Slot &slot = slots[index(h)];
+		return slot.hash == h ? slot.type : EVENT_MAX_ENUM;
+	}
+
+	// Only called for events not in eventNames, so this is off the hot path.
+	void warnUnknown(const std::string &name)
+	{
+		uint32_t h = hash(name.c_str(), name.length());
+
+		if (std::find(warned.begin(), warned.end(), h) == warned.end())
+		{
+			warned.push_back(h);
+			fprintf(stderr, "Missing event handler: %s\n", name.c_str());
+		}
+	}
+
+private:
+	enum { TABLE_BITS = 7, TABLE_SIZE = 1 << TABLE_BITS };
+
+	struct Slot
+	{
+		uint32_t hash;
+		EventType type;
+	};
+
+	static uint32_t hash(const char *str, size_t len)
+	{
+		uint32_t h = 2166136261u;
+
+		for (size_t i = 0; i < len; i++)
+			h = (h ^ (uint8_t) str[i]) * 16777619u;
+
+		return h;
+	}
 
-	if (!eventHandlerInitialized)
+	inline size_t index(uint32_t h) const
 	{
-		eventHandler["keypressed"] = &loveEventKeyPressed;
-		eventHandler["keyreleased"] = &loveEventKeyReleased;
-		eventHandlerInitialized = true;
+		return (size_t) ((h * multiplier) >> (32 - TABLE_BITS));
+	}
+
+	uint32_t multiplier;
+	Slot slots[TABLE_SIZE];
+	std::vector<uint32_t> warned;
+};
+
+static EventDispatcher eventDispatcher;
+
+static double getGCFrameTarget()
+{
+	if (gcFrameTarget != 0.0)
+		return gcFrameTarget;
+
+	if (gcFrameTargetDirty)
+	{
+		gcAutoFrameTarget = -1.0;
+
+		if (lovewrap::window::isLoaded())
+		{
+			int w, h;
+			love::window::WindowSettings settings;
+			lovewrap::window::getInstance()->getWindow(w, h, settings);
+
+			if (settings.vsync != 0 && settings.refreshrate > 0.0)
+				gcAutoFrameTarget = 1.0 / settings.refreshrate;
+		}
+
+		gcFrameTargetDirty = false;
+	}
+
+	return gcAutoFrameTarget;
+}
+
+static void collectGarbage(lua_State *L)
+{
+	double start = lovewrap::timer::getTime();
+	gcStats.steps = 0;
+	gcStats.cycleFinished = false;
+
+	switch (gcMode)
+	{
+		case lovewrap::GC_FULL:
+		{
+			lua_gc(L, LUA_GCCOLLECT, 0);
+			gcStats.cycleFinished = true;
+			break;
+		}
+		case lovewrap::GC_STEP:
+		{
+			// Use the time left before vsync, but not less than minimum budget.
+			double budget = gcMinBudget;
+			double target = getGCFrameTarget();
+			if (target > 0.0)
+				budget = std::max(budget, std::min(gcMaxBudget, target - (start - frameStartTime)));
+
+			double deadline = start + budget;
+			do
+			{
+				gcStats.steps++;
+
+				if (lua_gc(L, LUA_GCSTEP, 0))
+				{
+					gcStats.cycleFinished = true;
+					break;
+				}
+			} while (lovewrap::timer::getTime() < deadline);
+			break;
+		}
+		default:
+			break;
+	}
+
+	double end = lovewrap::timer::getTime();
+	gcStats.time = end - start;
+	lovewrap::profiler::record("gc", start, end);
+	gcStats.heapSize = ((size_t) lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + (size_t) lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+// Finishes loading scene of PUSH or REPLACE transition.
+static void loadTransitionScene(SceneTransition &t)
+{
+	try
+	{
+		if (t.loading.valid())
+			// Rethrows exception from loadAsync
+			t.loading.get();
+
+		t.scene->load(sceneArgs);
+	}
+	catch (...)
+	{
+		// The scene never made it to the scene stack.
+		t.scene->unload();
+		throw;
+	}
+}
+
+static void applySceneTransitions()
+{
+	while (!sceneTransitions.empty())
+	{
+		SceneTransition &front = sceneTransitions.front();
+
+		// Keep order, so later changes wait for this one too.
+		if (front.loading.valid() && front.loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			break;
+
+		SceneTransition t = std::move(front);
+		sceneTransitions.pop_front();
+
+		switch (t.type)
+		{
+			case SceneTransition::PUSH:
+			{
+				loadTransitionScene(t);
+				sceneStack.push_back(t.scene);
+				break;
+			}
+			case SceneTransition::POP:
+			{
+				if (sceneStack.size() <= 1)
+					throw love::Exception("Cannot pop the last scene");
+
+				lovewrap::Scene *old = sceneStack.back();
+				sceneStack.pop_back();
+				currentScene = sceneStack.back();
+				old->unload();
+				break;
+			}
+			case SceneTransition::REPLACE:
+			{
+				loadTransitionScene(t);
+
+				lovewrap::Scene *old = sceneStack.back();
+				sceneStack.back() = t.scene;
+				currentScene = t.scene;
+				old->unload();
+				break;
+			}
+		}
+
+		currentScene = sceneStack.back();
+	}
+}
+
+static void queueSceneTransition(SceneTransition::Type type, lovewrap::Scene *scene, bool async)
+{
+	SceneTransition t;
+	t.type = type;
+	t.scene = scene;
+
+	if (scene != nullptr)
+	{
+		if (async)
+			t.loading = std::async(std::launch::async, &lovewrap::Scene::loadAsync, scene);
+		else
+			scene->loadAsync();
 	}
 
+	sceneTransitions.push_back(std::move(t));
+}
+
+static int loveGameLoop(lua_State *L)
+{
 	double dt = 0;
+	frameStartTime = lovewrap::timer::getTime();
+	LOVEWRAP_PROFILE_SCOPE("frame");
+	lovewrap::job::endFrame();
+
+	if (!sceneTransitions.empty())
+	{
+		try
+		{
+			applySceneTransitions();
+		}
+		catch (std::exception &e)
+		{
+			// Not only love::Exception, as loadAsync can throw anything.
+			lua_pushstring(L, e.what());
+			lua_error(L);
+		}
+		catch (...)
+		{
+			lua_pushstring(L, "Unknown error while changing scene");
+			lua_error(L);
+		}
+	}
 
 	if (lovewrap::event::isLoaded())
 	{
+		LOVEWRAP_PROFILE_SCOPE("event");
 		auto inst = lovewrap::event::getInstance();
 
 		love::event::Message *msg = nullptr;
@@ -197,42 +626,90 @@ static int loveGameLoop(lua_State *L)
 
 		while (inst->poll(msg))
 		{
-			if (msg->name.compare("quit") == 0 && currentScene->quit() == false)
+			// Event::poll gives us the queue reference.
+			love::StrongRef<love::event::Message> msgRef(msg, love::Acquire::NORETAIN);
+			EventType type = eventDispatcher.find(msg->name);
+
+			if (type == EVENT_QUIT)
 			{
-				if (msg->args.size() > 0)
-					msg->args[0].toLua(L);
-				else
-					lua_pushinteger(L, 0);
+				if (currentScene->quit() == false)
+				{
+					if (msg->args.size() > 0)
+						msg->args[0].toLua(L);
+					else
+						lua_pushinteger(L, 0);
 
-				return 1;
+					return 1;
+				}
 			}
-			else
+			else if (type == EVENT_MAX_ENUM)
+				eventDispatcher.warnUnknown(msg->name);
+			else if (eventHandler[type] != nullptr)
 			{
-				auto iter = eventHandler.find(msg->name);
-				if (iter != eventHandler.end())
+				try
 				{
-					try
-					{
-						iter->second(msg->args);
-					}
-					catch (love::Exception &e)
-					{
-						fprintf(stderr, "Exception '%s': %s\n", msg->name.c_str(), e.what());
-						return luaL_error(L, "%s", e.what());
-					}
+					eventHandler[type](msg->args);
+				}
+				catch (love::Exception &e)
+				{
+					fprintf(stderr, "Exception '%s': %s\n", msg->name.c_str(), e.what());
+					return luaL_error(L, "%s", e.what());
 				}
-				else
-					fprintf(stderr, "Missing event handler: %s\n", msg->name.c_str());
 			}
 		}
 	}
 
+	{
+		LOVEWRAP_PROFILE_SCOPE("jobs");
+		try
+		{
+			lovewrap::job::processMainThread(lovewrap::job::getMainThreadBudget());
+		}
+		catch (love::Exception &e)
+		{
+			lua_pushstring(L, e.what());
+			lua_error(L);
+		}
+	}
+
 	if (lovewrap::timer::isLoaded())
+	{
+		LOVEWRAP_PROFILE_SCOPE("timer");
 		dt = lovewrap::timer::step();
+	}
+
+	double alpha = 1.0;
 
 	try
 	{
-		currentScene->update(dt);
+		if (fixedUpdateStep > 0.0)
+		{
+			int steps = 0;
+			updateAccumulator += dt;
+
+			while (updateAccumulator >= fixedUpdateStep && steps < fixedUpdateMaxSteps)
+			{
+				LOVEWRAP_PROFILE_SCOPE("update");
+				currentScene->update(fixedUpdateStep);
+				updateAccumulator -= fixedUpdateStep;
+				steps++;
+			}
+
+			// Can't catch up, drop the remaining time.
+			if (updateAccumulator >= fixedUpdateStep)
+				updateAccumulator = std::fmod(updateAccumulator, fixedUpdateStep);
+
+			alpha = updateAccumulator / fixedUpdateStep;
+		}
+		else
+		{
+			LOVEWRAP_PROFILE_SCOPE("update");
+			currentScene->update(dt);
+		}
+
+		// Tasks started by update must finish before draw.
+		LOVEWRAP_PROFILE_SCOPE("fence");
+		lovewrap::job::getFrameFence().wait();
 	}
 	catch (love::Exception &e)
 	{
@@ -246,17 +723,32 @@ static int loveGameLoop(lua_State *L)
 		lovewrap::graphics::clear(lovewrap::graphics::getBackgroundColor());
 		try
 		{
-			currentScene->draw();
+			LOVEWRAP_PROFILE_SCOPE("draw");
+			currentScene->drawInterpolated(alpha);
 		}
 		catch (love::Exception &e)
 		{
 			lua_pushstring(L, e.what());
 			lua_error(L);
 		}
-		lua_gc(L, LUA_GCCOLLECT, 0);
+		collectGarbage(L);
+
+		LOVEWRAP_PROFILE_SCOPE("present");
 		lovewrap::graphics::present();
 	}
 
+	if (renderStep > 0.0)
+	{
+		double now = lovewrap::timer::getTime();
+		nextRenderTime += renderStep;
+
+		// Too far behind (or first frame), start over from now.
+		if (nextRenderTime < now - renderStep)
+			nextRenderTime = now;
+		else if (nextRenderTime > now && lovewrap::timer::isLoaded())
+			lovewrap::timer::sleep(nextRenderTime - now);
+	}
+
 	return 0;
 }
 
@@ -288,16 +780,23 @@ static int loveRun(lua_State *L)
 	}
 
 	lua_pop(L, 1);
+	sceneArgs = args;
 
 	try
 	{
+		currentScene->loadAsync();
 		currentScene->load(args);
 	}
-	catch (love::Exception &e)
+	catch (std::exception &e)
 	{
 		lua_pushstring(L, e.what());
 		lua_error(L);
 	}
+	catch (...)
+	{
+		lua_pushstring(L, "Unknown error while loading scene");
+		lua_error(L);
+	}
 
 	lua_pushcfunction(L, &loveGameLoop);
 	return 1;
@@ -334,14 +833,151 @@ namespace lovewrap
 lua_CFunction initializeScene(Scene *scene)
 {
 	currentScene = scene;
+	sceneStack.assign(1, scene);
 	return &baseMain;
 }
 
+void pushScene(Scene *scene, bool async)
+{
+	queueSceneTransition(SceneTransition::PUSH, scene, async);
+}
+
+void popScene()
+{
+	queueSceneTransition(SceneTransition::POP, nullptr, false);
+}
+
+void replaceScene(Scene *scene, bool async)
+{
+	queueSceneTransition(SceneTransition::REPLACE, scene, async);
+}
+
+Scene *getCurrentScene()
+{
+	return currentScene;
+}
+
+// Unloading continues with the other scenes if one throws.
+static void unloadScene(Scene *scene)
+{
+	try
+	{
+		scene->unload();
+	}
+	catch (std::exception &e)
+	{
+		fprintf(stderr, "Exception while unloading scene: %s\n", e.what());
+	}
+	catch (...)
+	{
+		fprintf(stderr, "Unknown exception while unloading scene\n");
+	}
+}
+
+void deinitializeScenes()
+{
+	// Pending scenes never made it to the scene stack. Their loadAsync must finish
+	// before the modules it may use are gone.
+	for (SceneTransition &t: sceneTransitions)
+	{
+		if (t.loading.valid())
+		{
+			try
+			{
+				t.loading.get();
+			}
+			catch (...)
+			{
+				// The scene is unloaded anyway.
+			}
+		}
+
+		if (t.scene)
+			unloadScene(t.scene);
+	}
+
+	sceneTransitions.clear();
+
+	while (!sceneStack.empty())
+	{
+		Scene *scene = sceneStack.back();
+		sceneStack.pop_back();
+		unloadScene(scene);
+	}
+
+	currentScene = nullptr;
+}
+
+bool isSceneLoading()
+{
+	for (const SceneTransition &t: sceneTransitions)
+	{
+		// Finished loads are applied at the start of the next frame.
+		if (t.loading.valid() && t.loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return true;
+	}
+
+	return false;
+}
+
+void setGCMode(GCMode mode)
+{
+	gcMode = mode;
+}
+
+GCMode getGCMode()
+{
+	return gcMode;
+}
+
+void setGCStepBudget(int minBudget, int maxBudget)
+{
+	gcMinBudget = std::max(minBudget, 0) * 0.000001;
+	gcMaxBudget = std::max(maxBudget, minBudget) * 0.000001;
+}
+
+void setGCFrameTarget(double seconds)
+{
+	gcFrameTarget = seconds;
+	gcFrameTargetDirty = true;
+}
+
+const GCStats &getGCStats()
+{
+	return gcStats;
+}
+
+void setFixedUpdateRate(double hz, int maxSteps)
+{
+	fixedUpdateStep = hz > 0.0 ? 1.0 / hz : 0.0;
+	fixedUpdateMaxSteps = std::max(maxSteps, 1);
+	updateAccumulator = 0.0;
+}
+
+double getFixedUpdateRate()
+{
+	return fixedUpdateStep > 0.0 ? 1.0 / fixedUpdateStep : 0.0;
+}
+
+void setRenderRate(double hz)
+{
+	renderStep = hz > 0.0 ? 1.0 / hz : 0.0;
+	nextRenderTime = 0.0;
+}
+
+double getRenderRate()
+{
+	return renderStep > 0.0 ? 1.0 / renderStep : 0.0;
+}
+
 Scene::Scene() {}
 Scene::~Scene() {}
+void Scene::loadAsync() {}
 void Scene::load(std::vector<std::string>) {}
+void Scene::unload() {}
 void Scene::update(double) {}
 void Scene::draw() {}
+void Scene::drawInterpolated(double) {draw();}
 bool Scene::quit() {return false;}
 void Scene::visible(bool) {}
 void Scene::focus(bool) {}
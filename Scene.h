@@ -40,9 +40,20 @@ class Scene
 {
 public:
 	virtual ~Scene();
+	// Called before load(). When the scene is pushed with async = true, this is called in
+	// background thread while the current scene keeps running, so only do CPU-side work
+	// here (reading files, decoding ImageData, ...). Graphics objects must be created in load().
+	virtual void loadAsync();
 	virtual void load(std::vector<std::string> args);
+	// Called after the scene is removed from the scene stack. The scene stack no longer
+	// references the scene at this point, so it's safe to delete it here.
+	virtual void unload();
 	virtual void update(double deltaT);
 	virtual void draw();
+	// Called instead of draw() by the game loop. When fixed update rate is used, alpha is
+	// how far the current time is between the last update and the next one (0 to 1),
+	// which can be used to interpolate state. Otherwise it's always 1. Default calls draw().
+	virtual void drawInterpolated(double alpha);
 	virtual bool quit();
 	virtual void focus(bool f);
 	virtual void visible(bool v);
@@ -60,6 +71,90 @@ protected:
 
 lua_CFunction initializeScene(Scene *scene);
 
+/**
+ * Pushes scene on top of the scene stack. The top scene receives events, update and draw.
+ * Scene changes take effect at the start of the next frame. The scene stack doesn't take
+ * ownership of the scene. If Scene::loadAsync or Scene::load throws, Scene::unload is called
+ * and the error is raised from the game loop.
+ * @param scene Scene to push.
+ * @param async Whether to run Scene::loadAsync in background thread. The current scene
+ *              keeps running until it finishes.
+ */
+void pushScene(Scene *scene, bool async = false);
+/**
+ * Removes the top scene from the scene stack. Its Scene::unload is called afterwards.
+ */
+void popScene();
+/**
+ * Replaces the top scene. Same as popScene followed by pushScene, except the current scene
+ * is kept until the new scene is loaded.
+ * @param scene Scene to replace the top scene.
+ * @param async Whether to run Scene::loadAsync in background thread.
+ */
+void replaceScene(Scene *scene, bool async = false);
+Scene *getCurrentScene();
+/**
+ * Returns whether there are scene changes waiting for their Scene::loadAsync to finish.
+ */
+bool isSceneLoading();
+/**
+ * Waits for pending scene loads, then calls Scene::unload of pending scenes and of the scene
+ * stack from top to bottom, including the initial scene. Called by runGame when the game quits,
+ * before workers are stopped and the Lua state is closed.
+ */
+void deinitializeScenes();
+
+/**
+ * Sets update rate of the game loop. When set, Scene::update is called with fixed delta
+ * time, as many times as needed to catch up with real time, and Scene::drawInterpolated
+ * receives interpolation factor.
+ * @param hz Update rate, in updates per second. 0 means call update once per frame with
+ *           variable delta time (default).
+ * @param maxSteps Maximum amount of updates per frame. Remaining time is dropped if it's
+ *                 exceeded, so slow machine doesn't spiral.
+ */
+void setFixedUpdateRate(double hz, int maxSteps = 5);
+double getFixedUpdateRate();
+/**
+ * Limits how many frames are drawn per second, independent of update rate.
+ * @param hz Frames per second. 0 means no limit other than vsync (default).
+ */
+void setRenderRate(double hz);
+double getRenderRate();
+
+// Lua garbage collection done by the game loop after Scene::draw.
+enum GCMode
+{
+	GC_FULL, // Full collection every frame (default).
+	GC_STEP, // Incremental steps limited by time budget.
+	GC_OFF   // No collection by game loop, only Lua's own collector.
+};
+
+struct GCStats
+{
+	double time;        // Time spent in GC last frame, in seconds.
+	size_t heapSize;    // Lua heap size after GC last frame, in bytes.
+	int steps;          // Amount of LUA_GCSTEP done last frame.
+	bool cycleFinished; // Whether a collection cycle finished last frame.
+};
+
+void setGCMode(GCMode mode);
+GCMode getGCMode();
+/**
+ * Sets the time budget of GC_STEP mode.
+ * @param minBudget Time always spent for stepping, in microseconds.
+ * @param maxBudget Upper limit of time spent for stepping when there's still time left before
+ *                  the frame target, in microseconds.
+ */
+void setGCStepBudget(int minBudget, int maxBudget);
+/**
+ * Sets the frame time used to compute time left before vsync in GC_STEP mode.
+ * @param seconds Frame time in seconds. 0 means derive it from window refresh rate when vsync
+ *                is enabled, negative value disables it so only minimum budget is used.
+ */
+void setGCFrameTarget(double seconds);
+const GCStats &getGCStats();
+
 }
 
 #endif
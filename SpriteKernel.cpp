@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+#include <cmath>
+
+// lovewrap
+#include "SIMD.h"
+#include "SpriteKernel.h"
+
+namespace lovewrap
+{
+namespace sprite
+{
+
+using namespace simd;
+
+const char *getKernelName()
+{
+	return simd::getName();
+}
+
+// Sprites are processed in blocks, so per-sprite inputs fit in the stack.
+static const size_t BLOCK_SIZE = 64;
+
+QuadInfo getQuadInfo(love::graphics::Quad *quad)
+{
+	QuadInfo info;
+	love::graphics::Quad::Viewport v = quad->getViewport();
+	const love::Vector2 *texCoords = quad->getVertexTexCoords();
+
+	info.w = (float) v.w;
+	info.h = (float) v.h;
+	std::copy(texCoords, texCoords + 4, info.texCoords);
+	return info;
+}
+
+static inline uint8_t multiplyColor(uint8_t a, float b)
+{
+	return (uint8_t) (a * b + 0.5f);
+}
+
+void generateVertices(const Affine2D &transform, love::Colorf color, const graphics::SpriteArrays &sprites, size_t first, size_t count, const QuadInfo *quads, size_t quadCount, Vertex *out)
+{
+	bool white = color.r == 1.0f && color.g == 1.0f && color.b == 1.0f && color.a == 1.0f;
+	love::Color32 defaultColor = love::toColor32(color);
+
+	// Per block inputs. Rotation is turned to cos/sin, scale defaults to 1.
+	float cs[BLOCK_SIZE], sn[BLOCK_SIZE], sx[BLOCK_SIZE], sy[BLOCK_SIZE], w[BLOCK_SIZE], h[BLOCK_SIZE];
+	// Outputs: corner positions
+	float px[4][BLOCK_SIZE], py[4][BLOCK_SIZE];
+
+	const float4 ga = set4(transform.a), gb = set4(transform.b);
+	const float4 gc = set4(transform.c), gd = set4(transform.d);
+	const float4 gtx = set4(transform.tx), gty = set4(transform.ty);
+	const float4 ox = set4(sprites.ox), oy = set4(sprites.oy);
+
+	for (size_t start = first; start < first + count; start += BLOCK_SIZE)
+	{
+		size_t n = std::min(BLOCK_SIZE, first + count - start);
+		// Round up, padding is filled with copies of the first sprite.
+		size_t n4 = (n + 3) & ~(size_t) 3;
+		float x[BLOCK_SIZE], y[BLOCK_SIZE];
+
+		for (size_t i = 0; i < n4; i++)
+		{
+			size_t j = start + (i < n ? i : 0);
+			float r = sprites.rotation.size ? sprites.rotation[j] : 0.0f;
+			size_t q = sprites.quad.size ? sprites.quad[j] : 0;
+
+			if (q >= quadCount)
+				throw love::Exception("Invalid quad index %d for sprite %d.", (int) q, (int) j + 1);
+
+			x[i] = sprites.x[j];
+			y[i] = sprites.y[j];
+			cs[i] = r == 0.0f ? 1.0f : cosf(r);
+			sn[i] = r == 0.0f ? 0.0f : sinf(r);
+			sx[i] = sprites.scaleX.size ? sprites.scaleX[j] : 1.0f;
+			sy[i] = sprites.scaleY.size ? sprites.scaleY[j] : sx[i];
+			w[i] = quads[q].w;
+			h[i] = quads[q].h;
+		}
+
+		for (size_t i = 0; i < n4; i += 4)
+		{
+			float4 c = load4(cs + i), s = load4(sn + i);
+			float4 scaleX = load4(sx + i), scaleY = load4(sy + i);
+
+			// Sprite transform: translate, rotate, scale, then origin.
+			float4 la = mul4(c, scaleX);
+			float4 lb = mul4(s, scaleX);
+			float4 lc = sub4(set4(0.0f), mul4(s, scaleY));
+			float4 ld = mul4(c, scaleY);
+			float4 ltx = sub4(sub4(load4(x + i), mul4(ox, la)), mul4(oy, lc));
+			float4 lty = sub4(sub4(load4(y + i), mul4(ox, lb)), mul4(oy, ld));
+
+			// Then the current transform.
+			float4 a = add4(mul4(ga, la), mul4(gc, lb));
+			float4 b = add4(mul4(gb, la), mul4(gd, lb));
+			float4 cc = add4(mul4(ga, lc), mul4(gc, ld));
+			float4 d = add4(mul4(gb, lc), mul4(gd, ld));
+			float4 tx = add4(add4(mul4(ga, ltx), mul4(gc, lty)), gtx);
+			float4 ty = add4(add4(mul4(gb, ltx), mul4(gd, lty)), gty);
+
+			// Corners (0, 0), (0, h), (w, 0), (w, h)
+			float4 qw = load4(w + i), qh = load4(h + i);
+			float4 aw = mul4(a, qw), bw = mul4(b, qw);
+			float4 ch = mul4(cc, qh), dh = mul4(d, qh);
+
+			store4(px[0] + i, tx);
+			store4(py[0] + i, ty);
+			store4(px[1] + i, add4(ch, tx));
+			store4(py[1] + i, add4(dh, ty));
+			store4(px[2] + i, add4(aw, tx));
+			store4(py[2] + i, add4(bw, ty));
+			store4(px[3] + i, add4(add4(aw, ch), tx));
+			store4(py[3] + i, add4(add4(bw, dh), ty));
+		}
+
+		// Interleave into vertices.
+		for (size_t i = 0; i < n; i++)
+		{
+			size_t j = start + i;
+			const QuadInfo &q = quads[sprites.quad.size ? sprites.quad[j] : 0];
+			love::Color32 col = defaultColor;
+
+			if (sprites.color.size)
+			{
+				col = sprites.color[j];
+
+				if (!white)
+				{
+					col.r = multiplyColor(col.r, color.r);
+					col.g = multiplyColor(col.g, color.g);
+					col.b = multiplyColor(col.b, color.b);
+					col.a = multiplyColor(col.a, color.a);
+				}
+			}
+
+			for (int k = 0; k < 4; k++)
+			{
+				Vertex &v = out[(j - first) * 4 + k];
+				v.x = px[k][i];
+				v.y = py[k][i];
+				v.s = q.texCoords[k].x;
+				v.t = q.texCoords[k].y;
+				v.color = col;
+			}
+		}
+	}
+}
+
+} // sprite
+} // lovewrap
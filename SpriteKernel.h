@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_SPRITEKERNEL_H
+#define LOVEWRAP_SPRITEKERNEL_H
+
+// STL
+#include <cstddef>
+
+// lovewrap
+#include "Affine2D.h"
+#include "LOVEWrap.h"
+
+namespace lovewrap
+{
+
+// Vertex generation for many sprites at once, used by graphics::drawMany. The
+// math is done 4 sprites at a time with SSE2 or NEON when available.
+namespace sprite
+{
+
+typedef love::graphics::vertex::XYf_STf_RGBAub Vertex;
+
+// Size and texture coordinates of a Quad, in the order of its vertices.
+struct QuadInfo
+{
+	float w, h;
+	love::Vector2 texCoords[4];
+};
+
+/**
+ * Gets QuadInfo of a Quad.
+ */
+QuadInfo getQuadInfo(love::graphics::Quad *quad);
+/**
+ * Writes 4 vertices per sprite, in the same order as Quad vertices, for use with
+ * TriangleIndexMode::QUADS.
+ * @param transform Transform applied after each sprite transform.
+ * @param color Color multiplied with each sprite color.
+ * @param sprites The sprites.
+ * @param first Index of the first sprite.
+ * @param count Amount of sprites.
+ * @param quads Quads referenced by sprites.quad.
+ * @param quadCount Amount of quads. Out of range quad index throws love::Exception.
+ * @param out Destination, 4 * count vertices.
+ */
+void generateVertices(const Affine2D &transform, love::Colorf color, const graphics::SpriteArrays &sprites, size_t first, size_t count, const QuadInfo *quads, size_t quadCount, Vertex *out);
+/**
+ * Name of the instruction set used, "SSE2", "NEON" or "scalar".
+ */
+const char *getKernelName();
+
+} // sprite
+} // lovewrap
+
+#endif
@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// STL
+#include <algorithm>
+
+// lovewrap
+#include "StreamReader.h"
+
+namespace lovewrap
+{
+namespace filesystem
+{
+
+StreamReader::StreamReader(const std::string &path, size_t chunkSize, size_t chunkCount, bool readAhead)
+: StreamReader(path, 0, UINT64_MAX, chunkSize, chunkCount, readAhead)
+{
+}
+
+StreamReader::StreamReader(const std::string &path, uint64_t offset, uint64_t length, size_t chunkSize, size_t chunkCount, bool readAhead)
+: start(0)
+, length(0)
+, chunkSize(std::max(chunkSize, (size_t) 1))
+, readAhead(readAhead)
+, buffers(std::max(chunkCount, (size_t) 2))
+, current(-1)
+, reading(false)
+, readOffset(0)
+, nextOffset(0)
+{
+	open(path, offset, length);
+
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		buffers[i].resize(this->chunkSize);
+		freeBuffers.push_back(i);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	schedule();
+}
+
+StreamReader::~StreamReader()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	readAhead = false;
+
+	try
+	{
+		wait(lock, [this]() {return !reading;});
+	}
+	catch (...)
+	{
+		// Thrown by other tasks run while waiting, which can't be rethrown here.
+	}
+}
+
+void StreamReader::open(const std::string &path, uint64_t offset, uint64_t length)
+{
+	file.set(getInstance()->newFile(path.c_str()), love::Acquire::NORETAIN);
+
+	if (!file->open(love::filesystem::File::MODE_READ))
+		throw love::Exception("Could not open file %s.", path.c_str());
+
+	uint64_t size = (uint64_t) file->getSize();
+	start = std::min(offset, size);
+	this->length = std::min(length, size - start);
+}
+
+void StreamReader::schedule()
+{
+	if (!readAhead || reading || error || freeBuffers.empty() || readOffset >= length)
+		return;
+
+	size_t buffer = freeBuffers.back();
+	uint64_t offset = readOffset;
+
+	freeBuffers.pop_back();
+	reading = true;
+
+	fence.run([this, buffer, offset]()
+	{
+		std::exception_ptr exception;
+		size_t size = 0;
+
+		try
+		{
+			size = read(buffer, offset);
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		reading = false;
+
+		if (exception)
+		{
+			error = exception;
+			freeBuffers.push_back(buffer);
+		}
+		else
+		{
+			filled.push_back({buffer, size, offset});
+			readOffset = offset + size;
+		}
+
+		schedule();
+		cond.notify_all();
+	});
+}
+
+size_t StreamReader::read(size_t buffer, uint64_t offset)
+{
+	size_t size = (size_t) std::min((uint64_t) chunkSize, length - offset);
+
+	if (!file->seek(start + offset) || file->read(buffers[buffer].data(), (int64_t) size) != (int64_t) size)
+		throw love::Exception("Could not read file %s.", file->getFilename().c_str());
+
+	return size;
+}
+
+void StreamReader::wait(std::unique_lock<std::mutex> &lock, std::function<bool()> ready)
+{
+	if (job::isMainThread())
+	{
+		cond.wait(lock, ready);
+		return;
+	}
+
+	// Blocking a worker could deadlock when the read task is queued behind it, so
+	// the waiting thread runs tasks through the fence instead.
+	while (!ready())
+	{
+		lock.unlock();
+
+		try
+		{
+			fence.wait();
+		}
+		catch (...)
+		{
+			lock.lock();
+			throw;
+		}
+
+		lock.lock();
+	}
+}
+
+bool StreamReader::isReadyLocked() const
+{
+	return !readAhead || !filled.empty() || error || (!reading && readOffset >= length);
+}
+
+bool StreamReader::next(Chunk &chunk)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (current >= 0)
+	{
+		freeBuffers.push_back((size_t) current);
+		current = -1;
+	}
+
+	if (!readAhead)
+	{
+		if (nextOffset >= length)
+			return false;
+
+		size_t buffer = freeBuffers.back();
+		size_t size = read(buffer, nextOffset);
+
+		freeBuffers.pop_back();
+		current = (ptrdiff_t) buffer;
+		chunk.data = buffers[buffer].data();
+		chunk.size = size;
+		chunk.offset = nextOffset;
+		nextOffset = readOffset = nextOffset + size;
+		return true;
+	}
+
+	schedule();
+	wait(lock, [this]() {return isReadyLocked();});
+
+	// Chunks read before an error are still returned.
+	if (!filled.empty())
+	{
+		Filled f = filled.front();
+		filled.pop_front();
+
+		current = (ptrdiff_t) f.buffer;
+		chunk.data = buffers[f.buffer].data();
+		chunk.size = f.size;
+		chunk.offset = f.offset;
+		nextOffset = f.offset + f.size;
+		schedule();
+		return true;
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+
+	return false;
+}
+
+bool StreamReader::isReady()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return isReadyLocked();
+}
+
+void StreamReader::forEach(std::function<bool(const Chunk&)> callback)
+{
+	Chunk chunk;
+
+	while (next(chunk))
+	{
+		if (!callback(chunk))
+			break;
+	}
+}
+
+void StreamReader::seek(uint64_t offset)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	wait(lock, [this]() {return !reading;});
+
+	for (const Filled &f: filled)
+		freeBuffers.push_back(f.buffer);
+
+	if (current >= 0)
+		freeBuffers.push_back((size_t) current);
+
+	filled.clear();
+	current = -1;
+	error = nullptr;
+	readOffset = nextOffset = std::min(offset, length);
+	schedule();
+}
+
+uint64_t StreamReader::tell()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return nextOffset;
+}
+
+uint64_t StreamReader::getSize() const
+{
+	return length;
+}
+
+} // filesystem
+} // lovewrap
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#ifndef LOVEWRAP_STREAMREADER_H
+#define LOVEWRAP_STREAMREADER_H
+
+// STL
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// lovewrap
+#include "LOVEWrap.h"
+
+namespace lovewrap
+{
+namespace filesystem
+{
+
+// Reads file (or part of it) in fixed-size chunks, so big files can be parsed
+// incrementally with bounded memory. With read-ahead, chunks are read by worker
+// threads while the previous ones are processed.
+//
+//     StreamReader reader("replay.bin");
+//     for (const StreamReader::Chunk &chunk: reader)
+//         parse(chunk.data, chunk.size);
+class StreamReader
+{
+public:
+	struct Chunk
+	{
+		const char *data;
+		size_t size;
+		uint64_t offset; // Relative to start of the range
+	};
+
+	class iterator
+	{
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef Chunk value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const Chunk *pointer;
+		typedef const Chunk &reference;
+
+		iterator(): reader(nullptr) {}
+		explicit iterator(StreamReader *reader): reader(reader) { advance(); }
+
+		const Chunk &operator*() const { return chunk; }
+		const Chunk *operator->() const { return &chunk; }
+		iterator &operator++() { advance(); return *this; }
+		bool operator==(const iterator &other) const { return reader == other.reader; }
+		bool operator!=(const iterator &other) const { return reader != other.reader; }
+
+	private:
+		void advance()
+		{
+			if (reader && !reader->next(chunk))
+				reader = nullptr;
+		}
+
+		StreamReader *reader;
+		Chunk chunk;
+	};
+
+	/**
+	 * Opens file for streaming.
+	 * @param path The file path.
+	 * @param chunkSize Size of each chunk, in bytes.
+	 * @param chunkCount Amount of chunk buffers. Up to chunkCount - 1 chunks are read ahead.
+	 * @param readAhead Read chunks in worker threads? If false, chunks are read by next().
+	 */
+	StreamReader(const std::string &path, size_t chunkSize = 64 * 1024, size_t chunkCount = 4, bool readAhead = true);
+	/**
+	 * Opens range of file for streaming.
+	 * @param path The file path.
+	 * @param offset Start of the range, in bytes.
+	 * @param length Length of the range, in bytes. Clamped to the file size.
+	 */
+	StreamReader(const std::string &path, uint64_t offset, uint64_t length, size_t chunkSize = 64 * 1024, size_t chunkCount = 4, bool readAhead = true);
+	~StreamReader();
+
+	/**
+	 * Gets next chunk. Waits if it's still being read.
+	 * @param chunk Chunk to fill. Its data is valid until the next call to next() or seek().
+	 * @return false at the end of the range.
+	 */
+	bool next(Chunk &chunk);
+	/**
+	 * Checks whether next() would return without waiting, so the game loop can process
+	 * available chunks without blocking the frame.
+	 */
+	bool isReady();
+	/**
+	 * Calls callback for each remaining chunk.
+	 * @param callback Function to call. Return false to stop.
+	 */
+	void forEach(std::function<bool(const Chunk&)> callback);
+	/**
+	 * Restarts reading at offset. Chunks which were read ahead are discarded.
+	 * @param offset Offset relative to start of the range, in bytes.
+	 */
+	void seek(uint64_t offset);
+	// Offset of the next chunk, relative to start of the range.
+	uint64_t tell();
+	// Size of the range.
+	uint64_t getSize() const;
+
+	iterator begin() { return iterator(this); }
+	iterator end() { return iterator(); }
+
+private:
+	StreamReader(const StreamReader&) = delete;
+	StreamReader &operator=(const StreamReader&) = delete;
+
+	struct Filled
+	{
+		size_t buffer;
+		size_t size;
+		uint64_t offset;
+	};
+
+	void open(const std::string &path, uint64_t offset, uint64_t length);
+	// Must be called with mutex locked.
+	void schedule();
+	// Reads chunk into buffer. Called by one thread at a time: by the read-ahead task without
+	// mutex locked, or by next() with mutex locked when there's no read-ahead.
+	size_t read(size_t buffer, uint64_t offset);
+	// Waits until ready returns true. Worker threads run tasks meanwhile instead of blocking.
+	void wait(std::unique_lock<std::mutex> &lock, std::function<bool()> ready);
+	// Must be called with mutex locked.
+	bool isReadyLocked() const;
+
+	love::StrongRef<love::filesystem::File> file;
+	uint64_t start;
+	uint64_t length;
+	size_t chunkSize;
+	bool readAhead;
+
+	std::vector<std::vector<char>> buffers;
+	std::vector<size_t> freeBuffers;
+	std::deque<Filled> filled;
+	// Buffer held by the caller, or -1
+	ptrdiff_t current;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	// Tracks the read-ahead task.
+	job::Fence fence;
+	bool reading;
+	// Offset of the next chunk to read, relative to start.
+	uint64_t readOffset;
+	// Offset of the next chunk returned by next(), relative to start.
+	uint64_t nextOffset;
+	std::exception_ptr error;
+};
+
+} // filesystem
+} // lovewrap
+
+#endif
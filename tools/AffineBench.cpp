@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Measures the per-draw cost of building the draw transform and combining it with the
+// current transform, for the paths graphics::draw can take. Only needs LOVE's
+// common/Matrix.cpp. Build from the directory containing lovewrap:
+//
+//     c++ -std=c++11 -O2 -I. -I$LOVE_SRC lovewrap/tools/AffineBench.cpp
+//         $LOVE_SRC/common/Matrix.cpp -o AffineBench
+//     AffineBench [draws] [rounds]
+//
+// where LOVE_SRC is LOVE's src directory. Paths measured:
+//
+// - Matrix4: love::Matrix4(x, y, r, ...) multiplied with the current transform, as
+//   graphics::draw did before Affine2D.
+// - Affine2D, not batched: makeAffine, then toMatrix4, which Graphics::draw still
+//   multiplies with the current transform. Only building the transform gets cheaper.
+// - Affine2D, batched: the auto-batcher composes in 2D and converts the result once.
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// LOVE
+#include "common/Matrix.h"
+
+// lovewrap
+#include "lovewrap/Affine2D.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct DrawArgs
+{
+	float x, y, r, sx, sy, ox, oy, kx, ky;
+};
+
+// Keeps results alive.
+static float sink(const love::Matrix4 &m)
+{
+	const float *e = m.getElements();
+	return e[0] + e[5] + e[12] + e[13];
+}
+
+static float matrix4Path(const love::Matrix4 &current, const DrawArgs &d)
+{
+	love::Matrix4 local(d.x, d.y, d.r, d.sx, d.sy, d.ox, d.oy, d.kx, d.ky);
+	return sink(current * local);
+}
+
+static float affineUnbatchedPath(const love::Matrix4 &current, const DrawArgs &d)
+{
+	love::Matrix4 local = lovewrap::makeAffine(d.x, d.y, d.r, d.sx, d.sy, d.ox, d.oy, d.kx, d.ky).toMatrix4();
+	return sink(current * local);
+}
+
+static float affineBatchedPath(const love::Matrix4 &current, const DrawArgs &d)
+{
+	lovewrap::Affine2D affine = lovewrap::makeAffine(d.x, d.y, d.r, d.sx, d.sy, d.ox, d.oy, d.kx, d.ky);
+	return sink((lovewrap::Affine2D(current) * affine).toMatrix4());
+}
+
+// Returns nanoseconds per draw.
+template<typename F>
+static double measure(const love::Matrix4 &current, const std::vector<DrawArgs> &draws, int rounds, F func, float &result)
+{
+	Clock::time_point start = Clock::now();
+
+	for (int r = 0; r < rounds; r++)
+	{
+		for (const DrawArgs &d: draws)
+			result += func(current, d);
+	}
+
+	double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	return ns / ((double) draws.size() * rounds);
+}
+
+int main(int argc, char *argv[])
+{
+	int count = argc > 1 ? std::max(atoi(argv[1]), 1) : 100000;
+	int rounds = argc > 2 ? std::max(atoi(argv[2]), 1) : 50;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(0.0f, 1000.0f);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+	std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f);
+
+	// Camera: translated and scaled, like love.graphics.translate/scale.
+	love::Matrix4 current(-100.0f, -50.0f, 0.0f, 2.0f, 2.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+
+	const char *names[] = {"translate", "scale", "rotate"};
+	float result = 0.0f;
+
+	printf("%d draws, %d rounds, ns per draw\n", count, rounds);
+	printf("%-10s %10s %12s %12s\n", "", "Matrix4", "unbatched", "batched");
+
+	for (int kind = 0; kind < 3; kind++)
+	{
+		std::vector<DrawArgs> draws(count);
+
+		for (DrawArgs &d: draws)
+		{
+			d.x = position(rng);
+			d.y = position(rng);
+			d.r = kind == 2 ? angle(rng) : 0.0f;
+			d.sx = kind >= 1 ? scale(rng) : 1.0f;
+			d.sy = kind >= 1 ? scale(rng) : 1.0f;
+			d.ox = 16.0f;
+			d.oy = 16.0f;
+			d.kx = 0.0f;
+			d.ky = 0.0f;
+		}
+
+		double matrix4 = measure(current, draws, rounds, matrix4Path, result);
+		double unbatched = measure(current, draws, rounds, affineUnbatchedPath, result);
+		double batched = measure(current, draws, rounds, affineBatchedPath, result);
+
+		printf("%-10s %10.2f %12.2f %12.2f\n", names[kind], matrix4, unbatched, batched);
+	}
+
+	printf("checksum: %g\n", result);
+	return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Compares iterating ecs::World against updating heap objects through a virtual
+// function, the way game objects are usually written. Build from the directory
+// containing lovewrap, like Main.cpp:
+//
+//     c++ -std=c++11 -O2 -I. $LOVE_CFLAGS lovewrap/tools/ECSBench.cpp
+//         $(ls lovewrap/*.cpp | grep -v Main.cpp) $LOVE_LIBS -o ECSBench
+//     ECSBench [entities] [iterations]
+//
+// where LOVE_CFLAGS and LOVE_LIBS are the LOVE, Lua and SDL flags the game is
+// built with. Defaults to 100000 entities and 100 iterations.
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+// lovewrap
+#include "lovewrap/ECS.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Position
+{
+	float x, y;
+};
+
+struct Velocity
+{
+	float x, y;
+};
+
+struct GameObject
+{
+	virtual ~GameObject() {}
+	virtual void update(float dt) = 0;
+};
+
+struct Mover: GameObject
+{
+	Position position;
+	Velocity velocity;
+	char state[64]; // Stands for the rest of the object
+
+	Mover(float vx, float vy): position{0.0f, 0.0f}, velocity{vx, vy} {}
+
+	void update(float dt) override
+	{
+		position.x += velocity.x * dt;
+		position.y += velocity.y * dt;
+	}
+};
+
+static double elapsed(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	int count = argc > 1 ? std::max(atoi(argv[1]), 1) : 100000;
+	int iterations = argc > 2 ? std::max(atoi(argv[2]), 1) : 100;
+	const float dt = 1.0f / 60.0f;
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> speed(-100.0f, 100.0f);
+
+	lovewrap::ecs::World world;
+	std::vector<std::unique_ptr<GameObject>> objects;
+	// Other allocations made while the game runs, so objects don't end up next to each other.
+	std::vector<std::unique_ptr<char[]>> clutter;
+
+	for (int i = 0; i < count; i++)
+	{
+		float vx = speed(rng), vy = speed(rng);
+		world.create(Position{0.0f, 0.0f}, Velocity{vx, vy});
+		objects.emplace_back(new Mover(vx, vy));
+
+		for (int j = 0; j < 3; j++)
+			clutter.emplace_back(new char[48]);
+	}
+
+	// Objects get created and destroyed in no particular order over time.
+	std::shuffle(objects.begin(), objects.end(), rng);
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		lovewrap::ecs::Query<Position, const Velocity>::forEach(world, [dt](Position &p, const Velocity &v)
+		{
+			p.x += v.x * dt;
+			p.y += v.y * dt;
+		});
+	}
+	double ecs = elapsed(start);
+
+	start = Clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		for (std::unique_ptr<GameObject> &object: objects)
+			object->update(dt);
+	}
+	double virtuals = elapsed(start);
+
+	// Keep the results alive.
+	float sum = 0.0f;
+	lovewrap::ecs::Query<const Position>::forEach(world, [&sum](const Position &p) {sum += p.x;});
+	for (std::unique_ptr<GameObject> &object: objects)
+		sum -= static_cast<Mover*>(object.get())->position.x;
+
+	printf("%d entities, %d iterations\n", count, iterations);
+	printf("ecs::Query:       %8.3f ms per iteration\n", ecs / iterations);
+	printf("virtual update(): %8.3f ms per iteration\n", virtuals / iterations);
+	printf("checksum: %g\n", sum);
+
+	return 0;
+}
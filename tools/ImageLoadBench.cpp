@@ -0,0 +1,195 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Compares how graphics::newImage picks the image decoder (magic bytes, see
+// image::detectFormat) with the old way of trying CompressedImageData first and
+// catching the exception. Only decoding is measured, no window is needed.
+// Build from the directory containing lovewrap, like Main.cpp:
+//
+//     c++ -std=c++11 -O2 -I. $LOVE_CFLAGS lovewrap/tools/ImageLoadBench.cpp
+//         $(ls lovewrap/*.cpp | grep -v Main.cpp) $LOVE_LIBS -o ImageLoadBench
+//     ImageLoadBench [-n rounds] image...
+//
+// where LOVE_CFLAGS and LOVE_LIBS are the LOVE, Lua and SDL flags the game is
+// built with. Give it a mixed corpus, e.g. sprites/*.png sprites/*.jpg dds/*.dds.
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// LOVE
+#include "common/Exception.h"
+#include "common/Module.h"
+#include "modules/filesystem/FileData.h"
+#include "modules/image/Image.h"
+
+// lovewrap
+#include "lovewrap/LOVEWrap.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static love::filesystem::FileData *readFile(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == nullptr)
+		return nullptr;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	love::filesystem::FileData *fd = new love::filesystem::FileData((uint64_t) size, path);
+	if (fread(fd->getData(), 1, (size_t) size, f) != (size_t) size)
+	{
+		fd->release();
+		fd = nullptr;
+	}
+
+	fclose(f);
+	return fd;
+}
+
+// What newImage did before: exceptions pick the decoder.
+static void loadWithException(love::image::Image *module, love::filesystem::FileData *fd)
+{
+	try
+	{
+		module->newCompressedData(fd)->release();
+	}
+	catch (love::Exception &)
+	{
+		module->newImageData(fd)->release();
+	}
+}
+
+static void loadWithDetection(love::image::Image *module, love::filesystem::FileData *fd)
+{
+	if (lovewrap::image::isCompressed(fd))
+		module->newCompressedData(fd)->release();
+	else
+		module->newImageData(fd)->release();
+}
+
+static void dispatchWithException(love::image::Image *module, love::filesystem::FileData *fd)
+{
+	try
+	{
+		module->newCompressedData(fd)->release();
+	}
+	catch (love::Exception &)
+	{
+	}
+}
+
+template<typename F>
+static double measure(const std::vector<love::filesystem::FileData*> &files, int rounds, F func)
+{
+	Clock::time_point start = Clock::now();
+
+	for (int r = 0; r < rounds; r++)
+	{
+		for (love::filesystem::FileData *fd: files)
+			func(fd);
+	}
+
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = 3;
+	int arg = 1;
+
+	if (argc > 2 && strcmp(argv[1], "-n") == 0)
+	{
+		rounds = std::max(atoi(argv[2]), 1);
+		arg = 3;
+	}
+
+	if (arg >= argc)
+	{
+		fprintf(stderr, "Usage: %s [-n rounds] image...\n", argv[0]);
+		return 1;
+	}
+
+	love::image::Image *module = new love::image::Image();
+	love::Module::registerInstance(module);
+
+	std::vector<love::filesystem::FileData*> files;
+	int counts[lovewrap::image::FORMAT_MAX_ENUM] = {};
+
+	for (; arg < argc; arg++)
+	{
+		love::filesystem::FileData *fd = readFile(argv[arg]);
+		if (fd == nullptr)
+		{
+			fprintf(stderr, "Could not read %s\n", argv[arg]);
+			continue;
+		}
+
+		// Files LOVE can't load at all are left out.
+		try
+		{
+			loadWithDetection(module, fd);
+		}
+		catch (love::Exception &e)
+		{
+			fprintf(stderr, "Skipping %s: %s\n", argv[arg], e.what());
+			fd->release();
+			continue;
+		}
+
+		counts[lovewrap::image::detectFormat(fd->getData(), fd->getSize())]++;
+		files.push_back(fd);
+	}
+
+	if (files.empty())
+		return 1;
+
+	double exception = measure(files, rounds, [module](love::filesystem::FileData *fd) {loadWithException(module, fd);});
+	double detection = measure(files, rounds, [module](love::filesystem::FileData *fd) {loadWithDetection(module, fd);});
+	double exceptionDispatch = measure(files, rounds, [module](love::filesystem::FileData *fd) {dispatchWithException(module, fd);});
+	double detectionDispatch = measure(files, rounds, [](love::filesystem::FileData *fd) {lovewrap::image::isCompressed(fd);});
+	double loads = (double) files.size() * rounds;
+
+	printf("%d images, %d rounds\n", (int) files.size(), rounds);
+	printf("formats:");
+	for (int i = 0; i < lovewrap::image::FORMAT_MAX_ENUM; i++)
+	{
+		if (counts[i] > 0)
+			printf(" %d:%d", i, counts[i]);
+	}
+	printf(" (image::FileFormat)\n");
+
+	printf("load, exception fallback: %10.3f ms total, %8.2f us per image\n", exception, exception * 1000.0 / loads);
+	printf("load, magic bytes:        %10.3f ms total, %8.2f us per image\n", detection, detection * 1000.0 / loads);
+	printf("dispatch only, exception: %10.3f ms total, %8.2f us per image\n", exceptionDispatch, exceptionDispatch * 1000.0 / loads);
+	printf("dispatch only, detection: %10.3f ms total, %8.2f us per image\n", detectionDispatch, detectionDispatch * 1000.0 / loads);
+
+	for (love::filesystem::FileData *fd: files)
+		fd->release();
+
+	return 0;
+}
@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Builds lovewrap asset pack from a directory. Standalone, only needs zlib:
+//
+//     c++ -std=c++11 -I.. PackBuilder.cpp -lz -o PackBuilder
+//     PackBuilder [-z level] input_dir output.pack
+//
+// With -z, files are zlib compressed when it saves at least 1/8 of their size.
+// Otherwise they're stored uncompressed so they can be memory mapped.
+
+// STL
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// zlib
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// lovewrap
+#include "PackFormat.h"
+
+using namespace lovewrap::pack;
+
+struct Input
+{
+	std::string name; // Relative to input directory
+	std::string realPath;
+	uint64_t hash;
+};
+
+#ifdef _WIN32
+
+static void listFiles(const std::string &dir, const std::string &prefix, std::vector<Input> &out)
+{
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &data);
+
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		std::string name = data.cFileName;
+		if (name == "." || name == "..")
+			continue;
+
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			listFiles(dir + "\\" + name, prefix + name + "/", out);
+		else
+			out.push_back({prefix + name, dir + "\\" + name, 0});
+	}
+	while (FindNextFileA(find, &data));
+
+	FindClose(find);
+}
+
+#else
+
+static void listFiles(const std::string &dir, const std::string &prefix, std::vector<Input> &out)
+{
+	DIR *d = opendir(dir.c_str());
+	if (d == nullptr)
+		return;
+
+	while (dirent *e = readdir(d))
+	{
+		std::string name = e->d_name;
+		std::string path = dir + "/" + name;
+		struct stat st;
+
+		if (name == "." || name == ".." || stat(path.c_str(), &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+			listFiles(path, prefix + name + "/", out);
+		else if (S_ISREG(st.st_mode))
+			out.push_back({prefix + name, path, 0});
+	}
+
+	closedir(d);
+}
+
+#endif
+
+static bool readFile(const std::string &path, std::vector<char> &out)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return false;
+
+	out.clear();
+	char buf[65536];
+	size_t n;
+
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		out.insert(out.end(), buf, buf + n);
+
+	bool ok = ferror(f) == 0;
+	fclose(f);
+	return ok;
+}
+
+static void writePadding(FILE *f, uint64_t &offset, uint64_t alignment)
+{
+	static const char zeros[ALIGNMENT] = {0};
+	uint64_t padding = (alignment - offset % alignment) % alignment;
+
+	fwrite(zeros, 1, (size_t) padding, f);
+	offset += padding;
+}
+
+int main(int argc, char *argv[])
+{
+	int level = -1;
+	int arg = 1;
+
+	if (argc > 2 && strcmp(argv[1], "-z") == 0)
+	{
+		level = atoi(argv[2]);
+		arg = 3;
+	}
+
+	if (argc - arg != 2)
+	{
+		fprintf(stderr, "Usage: %s [-z level] input_dir output.pack\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<Input> inputs;
+	listFiles(argv[arg], std::string(), inputs);
+
+	for (Input &input: inputs)
+		input.hash = hashPath(input.name.c_str(), input.name.length());
+
+	// Sorted by hash for binary search, then name so collisions are adjacent.
+	std::sort(inputs.begin(), inputs.end(), [](const Input &a, const Input &b)
+	{
+		return a.hash != b.hash ? a.hash < b.hash : a.name < b.name;
+	});
+
+	FILE *f = fopen(argv[arg + 1], "wb");
+	if (f == nullptr)
+	{
+		fprintf(stderr, "Could not open %s\n", argv[arg + 1]);
+		return 1;
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.alignment = ALIGNMENT;
+	header.entryCount = inputs.size();
+
+	// Written again at the end.
+	fwrite(&header, sizeof(Header), 1, f);
+	uint64_t offset = sizeof(Header);
+
+	std::vector<TocEntry> toc;
+	std::string names;
+	std::vector<char> data, compressed;
+	uint64_t totalRaw = 0, totalStored = 0;
+
+	for (const Input &input: inputs)
+	{
+		if (!readFile(input.realPath, data))
+		{
+			fprintf(stderr, "Could not read %s\n", input.realPath.c_str());
+			fclose(f);
+			return 1;
+		}
+
+		TocEntry entry;
+		memset(&entry, 0, sizeof(TocEntry));
+		entry.hash = input.hash;
+		entry.rawSize = data.size();
+		entry.nameOffset = (uint32_t) names.length();
+		entry.nameLength = (uint32_t) input.name.length();
+		names += input.name;
+
+		const std::vector<char> *stored = &data;
+
+		if (level >= 0 && !data.empty())
+		{
+			uLongf size = compressBound((uLong) data.size());
+			compressed.resize(size);
+
+			if (compress2((Bytef *) compressed.data(), &size, (const Bytef *) data.data(), (uLong) data.size(), level) == Z_OK && size <= data.size() - data.size() / 8)
+			{
+				compressed.resize(size);
+				stored = &compressed;
+				entry.flags |= ENTRY_ZLIB;
+			}
+		}
+
+		writePadding(f, offset, ALIGNMENT);
+		entry.offset = offset;
+		entry.size = stored->size();
+		fwrite(stored->data(), 1, stored->size(), f);
+		offset += stored->size();
+
+		totalRaw += entry.rawSize;
+		totalStored += entry.size;
+		toc.push_back(entry);
+	}
+
+	writePadding(f, offset, sizeof(TocEntry));
+	header.tocOffset = offset;
+	fwrite(toc.data(), sizeof(TocEntry), toc.size(), f);
+	offset += toc.size() * sizeof(TocEntry);
+
+	header.namesOffset = offset;
+	header.namesSize = names.length();
+	fwrite(names.data(), 1, names.length(), f);
+
+	fseek(f, 0, SEEK_SET);
+	fwrite(&header, sizeof(Header), 1, f);
+
+	if (fclose(f) != 0)
+	{
+		fprintf(stderr, "Could not write %s\n", argv[arg + 1]);
+		return 1;
+	}
+
+	printf("%u files, %llu bytes, %llu bytes stored\n", (unsigned) inputs.size(), (unsigned long long) totalRaw, (unsigned long long) totalStored);
+	return 0;
+}
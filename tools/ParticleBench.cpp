@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2040 Dark Energy Processor
+ * 
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+// Measures particle::Emitter::update for one big emitter. Build from the directory
+// containing lovewrap, like Main.cpp:
+//
+//     c++ -std=c++11 -O2 -I. $LOVE_CFLAGS lovewrap/tools/ParticleBench.cpp
+//         $(ls lovewrap/*.cpp | grep -v Main.cpp) $LOVE_LIBS -o ParticleBench
+//     ParticleBench [particles] [workers] [frames]
+//
+// where LOVE_CFLAGS and LOVE_LIBS are the LOVE, Lua and SDL flags the game is
+// built with. Defaults to 1000000 particles, job::initialize default workers and
+// 300 frames. For single core numbers, run it as "taskset -c 0 ParticleBench 1000000 1".
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// lovewrap
+#include "lovewrap/Job.h"
+#include "lovewrap/Particles.h"
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char *argv[])
+{
+	int count = argc > 1 ? std::max(atoi(argv[1]), 1) : 1000000;
+	int workers = argc > 2 ? std::max(atoi(argv[2]), 0) : 0;
+	int frames = argc > 3 ? std::max(atoi(argv[3]), 1) : 300;
+	const float dt = 1.0f / 60.0f;
+
+	lovewrap::job::initialize(workers);
+
+	{
+		// Lifetime outlasts the run, so the particle count stays the same every frame.
+		lovewrap::particle::Emitter emitter((size_t) count);
+		emitter.setParticleLifetime(1000.0f, 2000.0f);
+		emitter.setEmissionArea(800.0f, 600.0f);
+		emitter.setSpread(6.2831853f);
+		emitter.setSpeed(20.0f, 100.0f);
+		emitter.setLinearAcceleration(0.0f, 50.0f);
+		emitter.setLinearDamping(0.5f);
+		emitter.setSpin(-1.0f, 1.0f);
+		emitter.setSizes({1.0f, 2.0f, 0.5f});
+		emitter.setColors({love::Colorf(1, 1, 1, 1), love::Colorf(1, 0.5f, 0, 1), love::Colorf(1, 0, 0, 0)});
+		emitter.emit((size_t) count);
+
+		// Warm up workers and caches.
+		for (int i = 0; i < 10; i++)
+			emitter.update(dt);
+
+		std::vector<double> times;
+		times.reserve(frames);
+
+		for (int i = 0; i < frames; i++)
+		{
+			Clock::time_point start = Clock::now();
+			emitter.update(dt);
+			times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+
+		std::sort(times.begin(), times.end());
+		double total = 0.0;
+		for (double t: times)
+			total += t;
+
+		printf("%d particles (%d alive), %d workers, %d frames\n", count, (int) emitter.getCount(), lovewrap::job::getWorkerCount(), frames);
+		printf("update: %8.3f ms average, %8.3f ms median, %8.3f ms min, %8.3f ms max\n", total / frames, times[frames / 2], times.front(), times.back());
+	}
+
+	lovewrap::job::deinitialize();
+	return 0;
+}